@@ -3,6 +3,7 @@
 
 #include <sys/socket.h>
 #include "io_service.h"
+#include "io_op.h"
 
 /**
  * @brief Asynchronously accepts a new connection on the listening socket
@@ -85,4 +86,143 @@ io_errcode async_connect(io_service *iosvc, int sockfd,
                          struct sockaddr const *addr, socklen_t addrlen,
                          io_handler hnd, io_errcode *errc);
 
+/**
+ * @brief Same as `async_accept()`, but gives up if no connection is accepted
+ * within `milliseconds` from the moment of this call
+ * 
+ * @param iosvc service to schedule accept on
+ * @param listen_sock listening socket
+ * @param addr out parameter; the address of the connecting peer
+ * @param addrlen in-out parameter; must contain the size of the memory block
+ * pointed to by `addr`, and gets filled with the actual size of the address
+ * @param hnd completion handler
+ * @param new_sock out parameter; gets set to the accepted socket, or to -1 if
+ * no connection was accepted
+ * @param errc out parameter; stores the operation's completion status
+ * @param milliseconds maximum duration to wait for a connection
+ * 
+ * @return `EIO_OK` The accept has been successfully scheduled
+ * 
+ * @return `EIO_NOMEM` Could not allocate necessary memory
+ * 
+ * @return `EIO_INVARG` The supplied handler's callback function is `NULL`, or
+ * `milliseconds` is negative
+ * 
+ * @return `EIO_STOPPED` The service has received a stop request
+ * 
+ * @return `EIO_INPROGRESS` A handler is already scheduled for the specified
+ * acceptor
+ * 
+ * Reported status through `errc` may be any of the statuses reported by
+ * `async_accept()`, or:
+ * 
+ * `EIO_TIMEOUT` No connection was accepted in time
+ */
+io_errcode async_accept_timeout(io_service *iosvc, int listen_sock,
+                                struct sockaddr *addr, socklen_t *addrlen,
+                                io_handler hnd, int *new_sock,
+                                io_errcode *errc, int milliseconds);
+
+/**
+ * @brief Same as `async_connect()`, but gives up if the connection is not
+ * established within `milliseconds` from the moment of this call
+ * 
+ * On timeout, the pending handshake is aborted, and the socket is left
+ * unconnected. The socket should be closed by the caller before a new
+ * connection attempt is made with a fresh one.
+ * 
+ * @param iosvc service to schedule connection on
+ * @param sockfd socket to peer
+ * @param addr pointer to address of peer
+ * @param addrlen pointer to size of `addr`
+ * @param hnd completion handler
+ * @param errc out parameter; stores the operation's completion status
+ * @param milliseconds maximum duration of the handshake
+ * 
+ * @return `EIO_OK` The connection has been successfully scheduled
+ * 
+ * @return `EIO_NOMEM` Could not allocate necessary memory
+ * 
+ * @return `EIO_INVARG` The supplied handler's callback function is `NULL`, or
+ * `milliseconds` is negative
+ * 
+ * @return `EIO_STOPPED` The service has received a stop request
+ * 
+ * @return `EIO_INPROGRESS` A connect is already scheduled for provided `sockfd`
+ * 
+ * @return `EIO_SYSERR` The handshake can not be initiated. Inspect `errno`
+ * 
+ * Reported status through `errc` may be any of the statuses reported by
+ * `async_connect()`, or:
+ * 
+ * `EIO_TIMEOUT` The connection was not established in time
+ */
+io_errcode async_connect_timeout(io_service *iosvc, int sockfd,
+                                 struct sockaddr const *addr,
+                                 socklen_t addrlen, io_handler hnd,
+                                 io_errcode *errc, int milliseconds);
+
+/**
+ * @brief Same as `async_accept()`, but the operation is stored in `op`,
+ * provided by the caller, instead of memory allocated by the library. See
+ * `io_op`
+ * 
+ * @param op storage of the operation; must stay valid until the handler is
+ * called
+ * 
+ * Other parameters, return values and reported statuses are the same as for
+ * `async_accept()`
+ */
+io_errcode async_accept_op(io_op *op, io_service *iosvc, int listen_sock,
+                           struct sockaddr *addr, socklen_t *addrlen,
+                           io_handler hnd, int *new_sock, io_errcode *errc);
+
+/**
+ * @brief Same as `async_connect()`, but the operation is stored in `op`,
+ * provided by the caller, instead of memory allocated by the library. See
+ * `io_op`
+ * 
+ * @param op storage of the operation; must stay valid until the handler is
+ * called
+ * 
+ * Other parameters, return values and reported statuses are the same as for
+ * `async_connect()`
+ */
+io_errcode async_connect_op(io_op *op, io_service *iosvc, int sockfd,
+                            struct sockaddr const *addr, socklen_t addrlen,
+                            io_handler hnd, io_errcode *errc);
+
+/**
+ * @brief Same as `async_accept_timeout()`, but the operation is stored in
+ * `op`, provided by the caller, instead of memory allocated by the library.
+ * See `io_op`
+ * 
+ * @param op storage of the operation; must stay valid until the handler is
+ * called
+ * 
+ * Other parameters, return values and reported statuses are the same as for
+ * `async_accept_timeout()`
+ */
+io_errcode async_accept_timeout_op(io_op *op, io_service *iosvc,
+                                   int listen_sock, struct sockaddr *addr,
+                                   socklen_t *addrlen, io_handler hnd,
+                                   int *new_sock, io_errcode *errc,
+                                   int milliseconds);
+
+/**
+ * @brief Same as `async_connect_timeout()`, but the operation is stored in
+ * `op`, provided by the caller, instead of memory allocated by the library.
+ * See `io_op`
+ * 
+ * @param op storage of the operation; must stay valid until the handler is
+ * called
+ * 
+ * Other parameters, return values and reported statuses are the same as for
+ * `async_connect_timeout()`
+ */
+io_errcode async_connect_timeout_op(io_op *op, io_service *iosvc, int sockfd,
+                                    struct sockaddr const *addr,
+                                    socklen_t addrlen, io_handler hnd,
+                                    io_errcode *errc, int milliseconds);
+
 #endif // ASYNC_NET_H_
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include "io_service.h"
+#include "io_op.h"
 
 /**
  * @brief Schedule an asynchronous read of at most `nbytes` from `fd` into `buf`
@@ -48,6 +49,10 @@ io_errcode async_read_some(io_service *iosvc, int fd, void *buf,
  * @brief Schedule an asynchronous write of at most `nbytes` into `fd` from `buf`
  * on the service `iosvc`, and call the provided handler when done.
  * 
+ * If `fd` is auto-corked (see `iosvc_set_autocork()`), the write is queued
+ * and flushed at the end of the current loop iteration, and all `nbytes` are
+ * written before the handler is called.
+ * 
  * @param iosvc service to schedule write on
  * @param fd file descriptor to write to
  * @param buf buffer to write from
@@ -133,6 +138,10 @@ io_errcode async_read(io_service *iosvc, int fd, void *buf, size_t nbytes,
  * `errc` is set to a value other than `EIO_OK`, the read might have provided
  * less bytes than requested.
  * 
+ * If `fd` is auto-corked (see `iosvc_set_autocork()`), the write is queued
+ * and flushed at the end of the current loop iteration, together with all
+ * other writes issued on `fd` during that iteration.
+ * 
  * @param iosvc service to schedule read on
  * @param fd file descriptor to read from
  * @param buf buffer to read into
@@ -171,4 +180,175 @@ io_errcode async_write(io_service *iosvc, int fd, void const *buf,
                        size_t nbytes, io_handler hnd, size_t *transferred,
                        io_errcode *errc);
 
+/**
+ * @brief Same as `async_read()`, but the whole operation must complete within
+ * `milliseconds` from the moment of this call. The deadline is carried across
+ * all the partial reads that make up the operation.
+ * 
+ * @param iosvc service to schedule read on
+ * @param fd file descriptor to read from
+ * @param buf buffer to read into
+ * @param nbytes number of bytes to transfer
+ * @param hnd completion handler
+ * @param transferred out parameter; number of bytes actually read is stored in
+ * the location pointed by this parameter
+ * @param errc out parameter; stores the operation's completion status
+ * @param milliseconds maximum duration of the whole operation
+ *
+ * @return `EIO_OK` The operation has been successfully scheduled
+ * 
+ * @return `EIO_NOMEM` Could not allocate necessary memory
+ * 
+ * @return `EIO_INVARG` The supplied handler's callback function is `NULL`, or
+ * `milliseconds` is negative
+ * 
+ * @return `EIO_STOPPED` The service has received a stop request
+ * 
+ * @return `EIO_INPROGRESS` A read has already been issued for this `fd`
+ * 
+ * Reported status through `errc` may be any of the statuses reported by
+ * `async_read()`, or:
+ * 
+ * `EIO_TIMEOUT` The deadline expired before all bytes were read. The number
+ * of bytes read so far is stored in `transferred`
+ */
+io_errcode async_read_deadline(io_service *iosvc, int fd, void *buf,
+                               size_t nbytes, io_handler hnd,
+                               size_t *transferred, io_errcode *errc,
+                               int milliseconds);
+
+/**
+ * @brief Same as `async_write()`, but the whole operation must complete
+ * within `milliseconds` from the moment of this call. The deadline is carried
+ * across all the partial writes that make up the operation.
+ * 
+ * Writes with a deadline can not be issued on auto-corked file descriptors
+ * (see `iosvc_set_autocork()`), nor on ones that still have corked writes
+ * pending after auto-cork was disabled, as they would be written ahead of
+ * the corked data.
+ * 
+ * @param iosvc service to schedule write on
+ * @param fd file descriptor to write to
+ * @param buf buffer to write from
+ * @param nbytes number of bytes to transfer
+ * @param hnd completion handler
+ * @param transferred out parameter; number of bytes actually written is stored
+ * in the location pointed by this parameter
+ * @param errc out parameter; stores the operation's completion status
+ * @param milliseconds maximum duration of the whole operation
+ *
+ * @return `EIO_OK` The operation has been successfully scheduled
+ * 
+ * @return `EIO_NOMEM` Could not allocate necessary memory
+ * 
+ * @return `EIO_INVARG` The supplied handler's callback function is `NULL`,
+ * `milliseconds` is negative, or writes on `fd` are corked
+ * 
+ * @return `EIO_STOPPED` The service has received a stop request
+ * 
+ * @return `EIO_INPROGRESS` A write has already been issued for this `fd`
+ * 
+ * Reported status through `errc` may be any of the statuses reported by
+ * `async_write()`, or:
+ * 
+ * `EIO_TIMEOUT` The deadline expired before all bytes were written. The
+ * number of bytes written so far is stored in `transferred`
+ */
+io_errcode async_write_deadline(io_service *iosvc, int fd, void const *buf,
+                                size_t nbytes, io_handler hnd,
+                                size_t *transferred, io_errcode *errc,
+                                int milliseconds);
+
+/**
+ * @brief Same as `async_read_some()`, but the operation is stored in `op`,
+ * provided by the caller, instead of memory allocated by the library. See
+ * `io_op`
+ * 
+ * @param op storage of the operation; must stay valid until the handler is
+ * called
+ * 
+ * Other parameters, return values and reported statuses are the same as for
+ * `async_read_some()`
+ */
+io_errcode async_read_some_op(io_op *op, io_service *iosvc, int fd, void *buf,
+                              size_t nbytes, io_handler hnd,
+                              size_t *transferred, io_errcode *errc);
+
+/**
+ * @brief Same as `async_write_some()`, but the operation is stored in `op`,
+ * provided by the caller, instead of memory allocated by the library. See
+ * `io_op`
+ * 
+ * @param op storage of the operation; must stay valid until the handler is
+ * called
+ * 
+ * Other parameters, return values and reported statuses are the same as for
+ * `async_write_some()`
+ */
+io_errcode async_write_some_op(io_op *op, io_service *iosvc, int fd,
+                               void const *buf, size_t nbytes, io_handler hnd,
+                               size_t *transferred, io_errcode *errc);
+
+/**
+ * @brief Same as `async_read()`, but the operation is stored in `op`,
+ * provided by the caller, instead of memory allocated by the library. See
+ * `io_op`
+ * 
+ * @param op storage of the operation; must stay valid until the handler is
+ * called
+ * 
+ * Other parameters, return values and reported statuses are the same as for
+ * `async_read()`
+ */
+io_errcode async_read_op(io_op *op, io_service *iosvc, int fd, void *buf,
+                         size_t nbytes, io_handler hnd, size_t *transferred,
+                         io_errcode *errc);
+
+/**
+ * @brief Same as `async_write()`, but the operation is stored in `op`,
+ * provided by the caller, instead of memory allocated by the library. See
+ * `io_op`
+ * 
+ * @param op storage of the operation; must stay valid until the handler is
+ * called
+ * 
+ * Other parameters, return values and reported statuses are the same as for
+ * `async_write()`
+ */
+io_errcode async_write_op(io_op *op, io_service *iosvc, int fd,
+                          void const *buf, size_t nbytes, io_handler hnd,
+                          size_t *transferred, io_errcode *errc);
+
+/**
+ * @brief Same as `async_read_deadline()`, but the operation is stored in
+ * `op`, provided by the caller, instead of memory allocated by the library.
+ * See `io_op`
+ * 
+ * @param op storage of the operation; must stay valid until the handler is
+ * called
+ * 
+ * Other parameters, return values and reported statuses are the same as for
+ * `async_read_deadline()`
+ */
+io_errcode async_read_deadline_op(io_op *op, io_service *iosvc, int fd,
+                                  void *buf, size_t nbytes, io_handler hnd,
+                                  size_t *transferred, io_errcode *errc,
+                                  int milliseconds);
+
+/**
+ * @brief Same as `async_write_deadline()`, but the operation is stored in
+ * `op`, provided by the caller, instead of memory allocated by the library.
+ * See `io_op`
+ * 
+ * @param op storage of the operation; must stay valid until the handler is
+ * called
+ * 
+ * Other parameters, return values and reported statuses are the same as for
+ * `async_write_deadline()`
+ */
+io_errcode async_write_deadline_op(io_op *op, io_service *iosvc, int fd,
+                                   void const *buf, size_t nbytes,
+                                   io_handler hnd, size_t *transferred,
+                                   io_errcode *errc, int milliseconds);
+
 #endif // ASYNC_RDWR_H_
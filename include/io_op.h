@@ -0,0 +1,59 @@
+#ifndef IO_OP_H_
+#define IO_OP_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "io_service.h"
+
+/**
+ * @brief Storage of an asynchronous operation, provided by the caller to the
+ * `async_XXX_op()` functions, so that no memory is allocated by the library
+ * for the operation. Typically embedded in the object owning the file
+ * descriptor (e.g. a connection), one per concurrent operation:
+ * 
+ * @code
+ * typedef struct {
+ *     int sock;
+ *     io_op rd_op;
+ *     io_op wr_op;
+ *     // ...
+ * } connection;
+ * 
+ * async_read_op(&conn->rd_op, iosvc, conn->sock, ...);
+ * @endcode
+ * 
+ * The storage must stay valid, and must not be passed to another call, until
+ * the operation's completion handler is called. It may be reused (or
+ * released) from within the handler itself. Writes queued on an auto-corked
+ * file descriptor (see `iosvc_set_autocork()`) leave the storage unused.
+ * 
+ * All members are private.
+ */
+typedef struct io_op {
+    io_service *iosvc;
+    io_handler hnd;
+    io_errcode *errc;
+    int fd;
+    int allocated;    // Allocated by the library, if no storage was provided
+    int remaining;    // Timeout storage of accept and connect
+    io_wait_type op_type;
+    int64_t deadline; // -1 if the operation has no deadline
+
+    union {
+        struct {
+            void *buf;
+            size_t nbytes;
+            size_t *transferred;
+        } rw;
+
+        struct {
+            struct sockaddr *addr;
+            socklen_t *addrlen;
+            int *new_sock;
+        } acc;
+    };
+} io_op;
+
+#endif // IO_OP_H_
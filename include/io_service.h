@@ -1,6 +1,8 @@
 #ifndef IO_SERVICE_H_
 #define IO_SERVICE_H_ 1
 
+#include <stddef.h>
+
 #include "iotypes.h"
 
 /**
@@ -10,6 +12,53 @@
  */
 typedef struct io_service io_service;
 
+/**
+ * @brief Statistics of the time spent by a service waiting for events, while
+ * busy-polling is enabled (see `iosvc_set_busy_poll()`).
+ * 
+ * Consists of `spin_us` and `blocked_us`, the total time (in microseconds)
+ * spent spinning, respectively blocked in `poll()`, and `spin_wakeups` and
+ * `blocked_wakeups`, the number of waits that completed while spinning,
+ * respectively that blocked
+ */
+typedef struct {
+    uint64_t spin_us;
+    uint64_t blocked_us;
+    uint64_t spin_wakeups;
+    uint64_t blocked_wakeups;
+} io_poll_stats;
+
+/**
+ * @brief Capacity of a service created by `iosvc_create_fixed()`.
+ * 
+ * Consists of:
+ * 
+ * `fds` the maximum number of file descriptors with scheduled events, or with
+ * settings (see `iosvc_set_fd_priority()` and `iosvc_set_autocork()`). A file
+ * descriptor whose events all completed is counted until the end of the
+ * current loop iteration
+ * 
+ * `timers` the maximum number of pending timers of each kind: events
+ * scheduled with a timeout or deadline, delayed and periodic handlers, and
+ * entries of timeout classes (see `iosvc_add_timeout_class()`)
+ * 
+ * `handlers` the maximum number of posted handlers pending at once, per
+ * priority
+ * 
+ * `handles` the maximum number of operation handles (`io_op_handle`) in use at
+ * once
+ * 
+ * `corked_writes` the maximum number of writes queued at once on each
+ * auto-corked file descriptor
+ */
+typedef struct {
+    size_t fds;
+    size_t timers;
+    size_t handlers;
+    size_t handles;
+    size_t corked_writes;
+} io_capacity;
+
 /**
  * @brief Create a new `io_service` instance. Most programs need only a single
  * one
@@ -18,9 +67,101 @@ typedef struct io_service io_service;
  */
 io_service *iosvc_create();
 
+/**
+ * @brief Same as `iosvc_create()`, but all memory owned by the service (i.e.
+ * the service itself, its internal structures, the state of the asynchronous
+ * operations scheduled on it, and its semaphores) is allocated through
+ * `allocator`, e.g. to serve it from a per-thread arena, or to account for
+ * the memory used by each service.
+ * 
+ * Memory allocated by the library outside of a service (e.g. by
+ * `make_task_group()`) is still allocated with `malloc()`.
+ * 
+ * @param allocator allocator of the service, copied into the service. Its
+ * `ctx` must outlive the service. If `NULL`, `malloc()` and `free()` are used
+ * @return created instance, or `NULL` if it could not be allocated or if
+ * `allocator` lacks a callback
+ */
+io_service *iosvc_create_with_allocator(io_allocator const *allocator);
+
+/**
+ * @brief Create a service whose memory is all allocated upfront, according to
+ * `capacity`, for deterministic latency. Scheduling work beyond capacity fails
+ * with `EIO_NOMEM`, instead of growing the service's structures, so the
+ * service never calls its allocator while scheduling or dispatching.
+ * 
+ * Some structures are not covered by `capacity`, and still grow through the
+ * allocator. The operations that allocate, and should be avoided on
+ * latency-critical paths (e.g. done once at setup), are:
+ * 
+ * - the `async_XXX()` functions not taking an `io_op` (use their
+ *   `async_XXX_op()` variants instead), and waits on semaphores
+ * 
+ * - adding timeout classes (`iosvc_add_timeout_class()`) and loop hooks
+ *   (`iosvc_add_prepare_hook()` and the like)
+ * 
+ * - setting a priority, auto-cork or the listener flag on a file descriptor
+ *   that has no settings yet, which allocates its settings record (and, for
+ *   auto-cork, its queue of `capacity->corked_writes` writes). The record is
+ *   released once the file descriptor is back to the default settings
+ * 
+ * @param capacity capacity of the service
+ * @param allocator allocator of the service, as for
+ * `iosvc_create_with_allocator()`, or `NULL` to use `malloc()` and `free()`
+ * @return created instance, or `NULL` if it could not be allocated, if
+ * `capacity` is `NULL`, or if `allocator` lacks a callback
+ */
+io_service *iosvc_create_fixed(io_capacity const *capacity,
+                               io_allocator const *allocator);
+
+/**
+ * @brief Presize the structures of a service for the expected load, e.g. the
+ * number of connections it will serve, so that they do not grow (and copy
+ * their contents) repeatedly while load ramps up.
+ * 
+ * Structures of a service shrink once they are mostly unused, but never below
+ * the capacity reserved by the latest call of this function.
+ * `capacity->corked_writes` is ignored.
+ * 
+ * @param iosvc service to presize
+ * @param capacity expected load, as for `iosvc_create_fixed()`
+ * @return `EIO_OK` The structures have been presized
+ * 
+ * @return `EIO_NOMEM` Could not allocate necessary memory, or the service has
+ * fixed capacity, lower than requested. Some structures may have been
+ * presized
+ */
+io_errcode iosvc_reserve(io_service *iosvc, io_capacity const *capacity);
+
+/**
+ * @brief Release all unused memory held by the structures of a service, e.g.
+ * after a spike of load. The capacity reserved by `iosvc_reserve()` is
+ * released too, and no longer kept when structures shrink.
+ * 
+ * Two tables are only partly released, as their entries are referred to by
+ * index: the table of operation handles keeps one entry per handle ever
+ * handed out at once, so that stale handles stay invalid, and the table of
+ * timeout class timers keeps its size while any class timer is armed.
+ * 
+ * Services with fixed capacity are left untouched.
+ * 
+ * @param iosvc service to trim
+ * @return `EIO_OK` All unused memory was released
+ * 
+ * @return `EIO_NOMEM` Some structures could not be moved to smaller
+ * allocations, and were left as they are
+ */
+io_errcode iosvc_trim(io_service *iosvc);
+
 /**
  * @brief Releases resources held by the provided `io_service` instance.
  * 
+ * Handlers of operations still pending are not called, including those of
+ * writes queued on auto-corked file descriptors (see `iosvc_set_autocork()`)
+ * that were not flushed yet. Stopping the service beforehand (see
+ * `iosvc_stop()`) completes all of them, with `EIO_STOPPED` if they could not
+ * finish.
+ * 
  * @param iosvc service to be freed
  * @par Returns
  *      Nothing.
@@ -37,8 +178,8 @@ void iosvc_delete(io_service *iosvc);
  * @param iosvc `io_service` whose event loop to run.
  * @return `EIO_OK` The event loop finished all scheduled tasks
  * 
- * @return `EIO_STOPPED` A call to `iosvc_stop()` was issued while the event loop
- * was running (by a completion handler)
+ * @return `EIO_STOPPED` A call to `iosvc_stop()` or `iosvc_drain()` was issued
+ * while the event loop was running (by a completion handler)
  * 
  * @return `EIO_INPROGRESS` The event loop is already running
  * 
@@ -46,6 +187,102 @@ void iosvc_delete(io_service *iosvc);
  */
 io_errcode iosvc_run(io_service *iosvc);
 
+/**
+ * @brief Runs a single iteration of the event loop without blocking: calls
+ * posted handlers, and the handlers of timers that are due and of events
+ * that are ready, then returns.
+ * 
+ * Unlike `iosvc_run()`, this function (as well as `iosvc_run_one()` and
+ * `iosvc_run_for()`) leaves the service ready to be run again, even if no
+ * work is pending anymore, so that the event loop can be driven by a host
+ * loop (e.g. once per frame). While the service is not being run, handlers
+ * can be posted and scheduled, and operations cancelled, as usual. Stopping
+ * the service from within a handler still finishes it, as for `iosvc_run()`.
+ * 
+ * @param iosvc `io_service` whose event loop to run
+ * @param handled out parameter; gets set to the number of handlers called
+ * (a file descriptor with several ready events counts once). Ignored if
+ * `NULL`
+ * @return `EIO_OK` The iteration has completed, and the service is ready
+ * to be run again
+ * 
+ * @return `EIO_STOPPED` A call to `iosvc_stop()` was issued while the event
+ * loop was running (by a completion handler), or the service was drained (see
+ * `iosvc_drain()`)
+ * 
+ * @return `EIO_INPROGRESS` The event loop is already running
+ * 
+ * @return `EIO_INVARG` The service has finished execution and was not reset
+ */
+io_errcode iosvc_poll(io_service *iosvc, size_t *handled);
+
+/**
+ * @brief Runs the event loop until at least one handler has been called, or
+ * no work is pending anymore. Blocks while waiting for events, as
+ * `iosvc_run()` does. See `iosvc_poll()` for details
+ * 
+ * @param iosvc `io_service` whose event loop to run
+ * @param handled out parameter; gets set to the number of handlers called
+ * (handlers that are ready together are called together). Ignored if `NULL`
+ * @return Same as `iosvc_poll()`
+ */
+io_errcode iosvc_run_one(io_service *iosvc, size_t *handled);
+
+/**
+ * @brief Runs the event loop for at most `milliseconds`, or until no work is
+ * pending anymore. See `iosvc_poll()` for details
+ * 
+ * @param iosvc `io_service` whose event loop to run
+ * @param milliseconds maximum duration to run for
+ * @param handled out parameter; gets set to the number of handlers called.
+ * Ignored if `NULL`
+ * @return Same as `iosvc_poll()`. `EIO_INVARG` is also returned if
+ * `milliseconds` is negative
+ */
+io_errcode iosvc_run_for(io_service *iosvc, int milliseconds,
+                         size_t *handled);
+
+/**
+ * @brief Gets a single file descriptor that becomes readable whenever any
+ * event awaited by the service is triggered, so that the service can be
+ * nested in a foreign event loop (e.g. GLib's), without a dedicated thread.
+ * Together with `iosvc_next_timeout()`, the foreign loop drives the service
+ * as follows:
+ * 
+ * @code
+ * int fd = iosvc_get_fd(iosvc);
+ * for (;;) {
+ *     struct pollfd pfd = {.fd = fd, .events = POLLIN};
+ *     poll(&pfd, 1, iosvc_next_timeout(iosvc)); // Or the foreign loop's wait
+ *     iosvc_poll(iosvc, NULL);
+ * }
+ * @endcode
+ * 
+ * The descriptor is created on the first call, and is kept in sync with the
+ * events scheduled on the service from then on. It is owned by the service
+ * and closed by `iosvc_delete()`. It is an epoll instance, so this is only
+ * supported on Linux.
+ * 
+ * @param iosvc service to get the descriptor of
+ * @return The descriptor, or -1 if it could not be created. Cause is found
+ * via inspecting `errno` (`ENOSYS` if not supported)
+ */
+int iosvc_get_fd(io_service *iosvc);
+
+/**
+ * @brief Gets the time until the service has work to do that is not
+ * signalled by the descriptor of `iosvc_get_fd()`, i.e. until its next timer
+ * expires. The service should be run (e.g. via `iosvc_poll()`) once this
+ * time elapses, or once the descriptor becomes readable, whichever comes
+ * first. Should be queried anew before each wait.
+ * 
+ * @param iosvc service to query
+ * @return Time until the next timer expires, in milliseconds, 0 if the
+ * service has work to do right away (e.g. posted handlers), or -1 if no
+ * timers are pending
+ */
+int iosvc_next_timeout(io_service *iosvc);
+
 /**
  * @brief Stops an `io_service`'s event loop.
  *
@@ -76,6 +313,40 @@ io_errcode iosvc_run(io_service *iosvc);
  */
 io_errcode iosvc_stop(io_service *iosvc);
 
+/**
+ * @brief Request a graceful stop of an `io_service`, e.g. before a restart.
+ * Unlike `iosvc_stop()`, work in flight is left to complete normally:
+ * 
+ * * Pending events of listeners (see `iosvc_set_listener()`) are stopped,
+ * their handlers being called with `EIO_STOPPED`, and new events are rejected
+ * on them with `EIO_STOPPED`, so that no new work is accepted
+ * 
+ * * Other events, timers and posted handlers are served as usual, and new
+ * ones may still be scheduled, e.g. by the reads and writes of a request that
+ * is being served
+ * 
+ * * Once no work is left, the call to `iosvc_run()` returns, with the code
+ * `EIO_STOPPED`
+ * 
+ * * Work still pending at `deadline` is stopped as if by `iosvc_stop()`.
+ * Periodic handlers keep the service busy, so they should be cancelled by the
+ * application if the drain is to end before the deadline
+ * 
+ * `iosvc_stop()` may still be called while draining, to stop right away.
+ * 
+ * @param iosvc service whose event loop to drain
+ * @param deadline time (as given by `iosvc_now()`) to stop the remaining work
+ * at
+ * @return `EIO_OK` The drain request was received successfully
+ * 
+ * @return `EIO_INPROGRESS` The service is already draining or stopping
+ * 
+ * @return `EIO_INVARG` `deadline` is negative
+ * 
+ * @return `EIO_NOENTRY` The service's event loop is not running
+ */
+io_errcode iosvc_drain(io_service *iosvc, int64_t deadline);
+
 /**
  * @brief Reset a stopped or finished `io_service`, such that it can
  * be reused
@@ -88,6 +359,33 @@ io_errcode iosvc_stop(io_service *iosvc);
  */
 io_errcode iosvc_reset(io_service *iosvc);
 
+/**
+ * @brief Sets the per-iteration budget of the event loop, i.e. the maximum
+ * number of posted handlers, ready file descriptors and expired timers that
+ * are served by a single iteration. Work left over is served by the next
+ * iterations, which do not block while waiting for events, so that a burst
+ * of one kind of work (e.g. a handler that keeps re-posting itself) can not
+ * starve the others.
+ * 
+ * Ready file descriptors are served in a rotating order, so that no file
+ * descriptor is consistently served first. If file descriptors have
+ * different priorities (see `iosvc_set_fd_priority()`), at least one ready
+ * file descriptor of each priority is served per iteration, even once the
+ * budget is used up, so the event budget may be exceeded by up to two.
+ * 
+ * All budgets are 0 (i.e. unlimited) by default.
+ * 
+ * @param iosvc service to configure
+ * @param handlers maximum number of posted handlers run per iteration, or 0
+ * for no limit. Handlers posted while running handlers count too
+ * @param events maximum number of ready file descriptors served per
+ * iteration, or 0 for no limit
+ * @param timers maximum number of expired timers served per iteration, or 0
+ * for no limit
+ */
+void iosvc_set_budget(io_service *iosvc, size_t handlers, size_t events,
+                      size_t timers);
+
 /**
  * @brief Schedules a handler to be synchronously executed by a service
  * as soon as possible
@@ -105,6 +403,22 @@ io_errcode iosvc_reset(io_service *iosvc);
  */
 io_errcode iosvc_post(io_service *iosvc, io_handler hnd);
 
+/**
+ * @brief Same as `iosvc_post()`, but with a priority. Posted handlers of
+ * higher priority are always run before those of lower priority, including
+ * when the loop is saturated (see `iosvc_set_budget()`). Handlers of the same
+ * priority run in the order they were posted. `iosvc_post()` uses
+ * `IO_PRIO_NORMAL`
+ * 
+ * @param iosvc service to execute the handler on
+ * @param hnd handler to run
+ * @param prio priority of the handler
+ * @return Same as `iosvc_post()`. `EIO_INVARG` is also returned if `prio` is
+ * not a valid priority
+ */
+io_errcode iosvc_post_prio(io_service *iosvc, io_handler hnd,
+                           io_priority prio);
+
 /**
  * @brief Schedules a handler to be asynchronously executed by a service
  * when the supplied event is triggered
@@ -142,6 +456,47 @@ io_errcode iosvc_post(io_service *iosvc, io_handler hnd);
 io_errcode iosvc_sched(io_service *iosvc, io_event event, io_handler hnd,
                        io_errcode *status);
 
+/**
+ * @brief Same as `iosvc_sched()`, additionally producing a handle to the
+ * scheduled operation, which can be cancelled via `iosvc_cancel_op()`
+ * 
+ * @param iosvc service to execute the handler on
+ * @param event event to await for triggering
+ * @param hnd handler to run
+ * @param status completion status signalled by the service
+ * @param op out parameter; handle to the scheduled operation. Only valid if
+ * `EIO_OK` is returned. No handle is produced if `NULL`
+ * @return Same as `iosvc_sched()`
+ */
+io_errcode iosvc_sched_op(io_service *iosvc, io_event event, io_handler hnd,
+                          io_errcode *status, io_op_handle *op);
+
+/**
+ * @brief Schedule the handlers of many events at once, e.g. when registering
+ * a large number of connections on startup. Same as calling
+ * `iosvc_sched()` for each event in order, but memory is reserved once for
+ * all of them.
+ * 
+ * Events are scheduled until the first one that fails. Events scheduled
+ * before it are left scheduled.
+ * 
+ * @param iosvc service to execute the handlers on
+ * @param events events to await for triggering
+ * @param hnds handlers to run, one per event
+ * @param statuses completion statuses signalled by the service, one per
+ * event. None are signalled if `NULL`
+ * @param count number of events
+ * @param scheduled out parameter; number of events scheduled. Ignored if
+ * `NULL`
+ * @return `EIO_OK` All events have been scheduled
+ * 
+ * @return Otherwise, the error returned by `iosvc_sched()` for the first
+ * event that could not be scheduled
+ */
+io_errcode iosvc_sched_many(io_service *iosvc, io_event const *events,
+                            io_handler const *hnds, io_errcode *statuses,
+                            size_t count, size_t *scheduled);
+
 /**
  * @brief Cancel a pending event's handler. This results in immediately 
  * calling the handler, and setting its associated `io_errcode` status to
@@ -153,10 +508,76 @@ io_errcode iosvc_sched(io_service *iosvc, io_event event, io_handler hnd,
  * 
  * @return `EIO_NOENTRY` The specified event is not scheduled to this service
  * 
- * @return `EIO_INVARG` The service is not running
+ * @return `EIO_INVARG` The service is stopping or has stopped
  */
 io_errcode iosvc_cancel(io_service *iosvc, io_event event);
 
+/**
+ * @brief Cancel the handlers of many pending events at once. Same as calling
+ * `iosvc_cancel()` for each event in order. Events that are not scheduled
+ * are skipped
+ * 
+ * @param iosvc service where the events are scheduled
+ * @param events events to cancel
+ * @param count number of events
+ * @param cancelled out parameter; number of events cancelled. Ignored if
+ * `NULL`
+ * @return `EIO_OK` All events were cancelled
+ * 
+ * @return `EIO_NOENTRY` Some events are not scheduled to this service
+ * 
+ * @return `EIO_INVARG` The service is stopping or has stopped
+ */
+io_errcode iosvc_cancel_many(io_service *iosvc, io_event const *events,
+                             size_t count, size_t *cancelled);
+
+/**
+ * @brief Cancel a specific operation, via the handle produced when it was
+ * scheduled. The operation is found directly, without any lookup by file
+ * descriptor. Same as `iosvc_cancel()`, the handler is called immediately,
+ * and its associated `io_errcode` status is set to `EIO_CANCELLED`
+ * (if provided).
+ * 
+ * Cancelling an operation that has already completed (or was already
+ * cancelled) is safe, and has no effect.
+ * 
+ * @param iosvc service where the operation is scheduled
+ * @param op handle to the operation to cancel
+ * @return `EIO_OK` The operation was cancelled
+ * 
+ * @return `EIO_NOENTRY` The handle is stale (the operation has completed) or
+ * does not refer to an operation of this service
+ * 
+ * @return `EIO_INVARG` The service is stopping or has stopped
+ */
+io_errcode iosvc_cancel_op(io_service *iosvc, io_op_handle op);
+
+/**
+ * @brief Release the registration of a file descriptor with no pending
+ * events.
+ * 
+ * Once the last pending event of a file descriptor completes, its
+ * registration lingers until the end of the current event loop iteration, so
+ * that events scheduled on it meanwhile (e.g. by its completion handler,
+ * reading the next chunk of a stream) reuse it without any allocation.
+ * Lingering registrations are released by the service on its own, so calling
+ * this is never required; it only releases the registration right away, if
+ * the service is not running, or marks it for release at the end of the
+ * current iteration otherwise.
+ * 
+ * @param iosvc service the file descriptor is registered on
+ * @param fd file descriptor to release
+ * @return `EIO_OK` The registration was released, or, if the service is
+ * running, will be released before the event loop waits for events again
+ * 
+ * @return `EIO_NOENTRY` The file descriptor is not registered on this service
+ * 
+ * @return `EIO_INPROGRESS` Events are still pending on the file descriptor
+ * 
+ * @return `EIO_INVARG` The service is stopping or has stopped
+ */
+io_errcode iosvc_release_fd(io_service *iosvc, int fd);
+
 /**
  * @brief Schedules a handler to be executed after a delay.
  * 
@@ -185,6 +606,70 @@ io_errcode iosvc_cancel(io_service *iosvc, io_event event);
 io_errcode iosvc_post_delay(io_service *iosvc, io_handler hnd,
                             io_errcode *status, int milliseconds);
 
+/**
+ * @brief Same as `iosvc_post_delay()`, additionally producing a handle to the
+ * delayed handler, which can be cancelled via `iosvc_cancel_op()`. In that
+ * case, the reported status is `EIO_CANCELLED`.
+ * 
+ * @param iosvc service to schedule the handler on
+ * @param hnd handler to schedule
+ * @param status completion status signalled by the service
+ * @param milliseconds delay to wait from the moment this function is called
+ * (in milliseconds)
+ * @param op out parameter; handle to the delayed handler. Only valid if
+ * `EIO_OK` is returned. No handle is produced if `NULL`
+ * @return Same as `iosvc_post_delay()`
+ */
+io_errcode iosvc_post_delay_op(io_service *iosvc, io_handler hnd,
+                               io_errcode *status, int milliseconds,
+                               io_op_handle *op);
+
+/**
+ * @brief Schedules a handler to be executed periodically, every `interval`
+ * milliseconds, starting `interval` milliseconds from the moment this
+ * function is called.
+ * 
+ * Each deadline is computed from the previous one (not from the moment the
+ * handler was called), so the timer does not drift with the handler's run
+ * time or with loop lag. Ticks that are entirely missed (e.g. because a
+ * handler blocked for longer than `interval`) are skipped.
+ * 
+ * A periodic handler keeps `iosvc_run()` from returning until it is cancelled
+ * via `iosvc_cancel_op()` (possibly from within the handler itself), or the
+ * service is stopped.
+ * 
+ * @param iosvc service to schedule the handler on
+ * @param hnd handler to schedule
+ * @param status completion status signalled by the service on every call
+ * @param interval period of the handler (in milliseconds)
+ * @param op out parameter; handle used to cancel the periodic handler. Only
+ * valid if `EIO_OK` is returned. No handle is produced if `NULL`, in which
+ * case the handler runs until the service is stopped
+ * @return `EIO_OK` The handler has been successfully scheduled
+ * 
+ * @return `EIO_NOMEM` Could not allocate necessary memory
+ * 
+ * @return `EIO_INVARG` The supplied handler's callback function is `NULL`, or
+ * `interval` is not positive
+ * 
+ * @return `EIO_STOPPED` The service has received a stop request
+ * 
+ * If the `status` parameter is not `NULL`, the service will provide the
+ * completion status for the supplied handler before every call. Reported
+ * status might be:
+ * 
+ * `EIO_OK` The handler is called upon a tick of the timer
+ * 
+ * `EIO_CANCELLED` A call to `iosvc_cancel_op()` was performed for the handler.
+ * This is the last call of the handler
+ * 
+ * `EIO_STOPPED` A call to `iosvc_stop()` was made. This is the last call of
+ * the handler
+ */
+io_errcode iosvc_post_periodic(io_service *iosvc, io_handler hnd,
+                               io_errcode *status, int interval,
+                               io_op_handle *op);
+
 /**
  * @brief Schedules a handler to be asynchronously executed by a service
  * when the supplied event is triggered, or when a timeout expires
@@ -231,4 +716,399 @@ io_errcode iosvc_sched_timeout(io_service *iosvc, io_event event,
                                io_handler hnd, io_errcode *status,
                                int *milliseconds);
 
+/**
+ * @brief Same as `iosvc_sched_timeout()`, additionally producing a handle to
+ * the scheduled operation, which can be cancelled via `iosvc_cancel_op()`
+ * 
+ * @param iosvc service to execute the handler on
+ * @param event event to await for triggering
+ * @param hnd handler to run
+ * @param status completion status signalled by the service
+ * @param milliseconds pointer to in-out variable containing maximum timeout to
+ * wait (in milliseconds). The variable should live at least until the handler
+ * is called
+ * @param op out parameter; handle to the scheduled operation. Only valid if
+ * `EIO_OK` is returned. No handle is produced if `NULL`
+ * @return Same as `iosvc_sched_timeout()`
+ */
+io_errcode iosvc_sched_timeout_op(io_service *iosvc, io_event event,
+                                  io_handler hnd, io_errcode *status,
+                                  int *milliseconds, io_op_handle *op);
+
+/**
+ * @brief Current time of the clock used by the service for deadlines, i.e.
+ * the monotonic clock, in milliseconds. Deadlines for `iosvc_sched_until()`
+ * and `iosvc_post_at()` are expressed relative to this clock, e.g.:
+ * 
+ * @code
+ * int64_t deadline = iosvc_now() + 5000; // Whole request must take <5s
+ * iosvc_sched_until(iosvc, read_evt, on_header, &st, deadline, NULL);
+ * // ...then, in on_header:
+ * iosvc_sched_until(iosvc, read_evt, on_body, &st, deadline, NULL);
+ * @endcode
+ * 
+ * @return Current time, in milliseconds
+ */
+int64_t iosvc_now(void);
+
+/**
+ * @brief Same as `iosvc_sched_timeout_op()`, but the timeout is given as an
+ * absolute deadline on the clock of `iosvc_now()`, which is stored as is.
+ * This allows a single deadline to be carried across a chain of operations,
+ * without recomputing the remaining time for each of them.
+ * 
+ * A deadline that has already passed times out the event in the next
+ * iteration of the event loop, unless the event has been triggered.
+ * 
+ * @param iosvc service to execute the handler on
+ * @param event event to await for triggering
+ * @param hnd handler to run
+ * @param status completion status signalled by the service
+ * @param deadline time (as given by `iosvc_now()`) to time out at
+ * @param op out parameter; handle to the scheduled operation. Only valid if
+ * `EIO_OK` is returned. No handle is produced if `NULL`
+ * @return Same as `iosvc_sched_timeout()`. `EIO_INVARG` is also returned if
+ * `deadline` is negative
+ */
+io_errcode iosvc_sched_until(io_service *iosvc, io_event event,
+                             io_handler hnd, io_errcode *status,
+                             int64_t deadline, io_op_handle *op);
+
+/**
+ * @brief Same as `iosvc_post_delay_op()`, but the handler is called at an
+ * absolute deadline on the clock of `iosvc_now()`
+ * 
+ * @param iosvc service to execute the handler on
+ * @param hnd handler to run
+ * @param status completion status signalled by the service
+ * @param deadline time (as given by `iosvc_now()`) to call the handler at
+ * @param op out parameter; handle to the delayed handler. Only valid if
+ * `EIO_OK` is returned. No handle is produced if `NULL`
+ * @return Same as `iosvc_post_delay()`. `EIO_INVARG` is also returned if
+ * `deadline` is negative
+ */
+io_errcode iosvc_post_at(io_service *iosvc, io_handler hnd,
+                         io_errcode *status, int64_t deadline,
+                         io_op_handle *op);
+
+/**
+ * @brief Same as `iosvc_sched_timeout_op()`, but the timeout may expire up to
+ * `slack` milliseconds late, similar to Linux timer slack.
+ * 
+ * The deadline is rounded up to a multiple of the slack, so that timers with
+ * close deadlines and the same slack share a single deadline, and the event
+ * loop wakes up once for all of them instead of once per timer. This suits
+ * timers whose exact timing matters less than the wakeup rate, such as
+ * per-connection idle timeouts:
+ * 
+ * @code
+ * iosvc_sched_timeout_slack(iosvc, idle_evt, hnd, &st, &idle_ms, 50, NULL);
+ * @endcode
+ * 
+ * A slack of 0 makes the timer exact, which is what all other timers of the
+ * service are (timeout classes have their own slack, see
+ * `iosvc_add_timeout_class()`).
+ * 
+ * @param iosvc service to execute the handler on
+ * @param event event to await for triggering
+ * @param hnd handler to run
+ * @param status completion status signalled by the service
+ * @param milliseconds pointer to in-out variable containing maximum timeout to
+ * wait (in milliseconds). The variable should live at least until the handler
+ * is called
+ * @param slack how late (in milliseconds) the timeout is allowed to expire
+ * @param op out parameter; handle to the scheduled operation. Only valid if
+ * `EIO_OK` is returned. No handle is produced if `NULL`
+ * @return Same as `iosvc_sched_timeout()`. `EIO_INVARG` is also returned if
+ * `slack` is negative
+ */
+io_errcode iosvc_sched_timeout_slack(io_service *iosvc, io_event event,
+                                     io_handler hnd, io_errcode *status,
+                                     int *milliseconds, int slack,
+                                     io_op_handle *op);
+
+/**
+ * @brief Same as `iosvc_post_delay_op()`, but the handler may be called up to
+ * `slack` milliseconds late, so that close timers share a wakeup (see
+ * `iosvc_sched_timeout_slack()`)
+ * 
+ * @param iosvc service to schedule the handler on
+ * @param hnd handler to schedule
+ * @param status completion status signalled by the service
+ * @param milliseconds delay to wait from the moment this function is called
+ * (in milliseconds)
+ * @param slack how late (in milliseconds) the handler is allowed to be called
+ * @param op out parameter; handle to the delayed handler. Only valid if
+ * `EIO_OK` is returned. No handle is produced if `NULL`
+ * @return Same as `iosvc_post_delay()`. `EIO_INVARG` is also returned if
+ * `slack` is negative
+ */
+io_errcode iosvc_post_delay_slack(io_service *iosvc, io_handler hnd,
+                                  io_errcode *status, int milliseconds,
+                                  int slack, io_op_handle *op);
+
+/**
+ * @brief Same as `iosvc_post_periodic()`, but every tick may be up to `slack`
+ * milliseconds late, so that close timers share a wakeup (see
+ * `iosvc_sched_timeout_slack()`). Ticks still follow the nominal period, so
+ * the slack does not accumulate.
+ * 
+ * @param iosvc service to schedule the handler on
+ * @param hnd handler to schedule
+ * @param status completion status signalled by the service on every call
+ * @param interval period of the handler (in milliseconds)
+ * @param slack how late (in milliseconds) each tick is allowed to be
+ * @param op out parameter; handle used to cancel the periodic handler. No
+ * handle is produced if `NULL`
+ * @return Same as `iosvc_post_periodic()`. `EIO_INVARG` is also returned if
+ * `slack` is negative
+ */
+io_errcode iosvc_post_periodic_slack(io_service *iosvc, io_handler hnd,
+                                     io_errcode *status, int interval,
+                                     int slack, io_op_handle *op);
+
+/**
+ * @brief Registers a timeout class, i.e. a fixed timeout duration that is
+ * shared by many timers (such as a read idle timeout, or a request timeout).
+ * 
+ * Timers armed on a class via `iosvc_sched_class_timeout()` or
+ * `iosvc_post_class_delay()` all have the same duration, so they expire in
+ * the order they were armed. They are thus kept in a FIFO list instead of a
+ * heap, which makes arming and cancelling them O(1), and only the oldest
+ * timer of each class is considered when computing the next wakeup. The
+ * number of classes is expected to be small.
+ * 
+ * Timers of a class share the slack given here, which works like the one of
+ * `iosvc_sched_timeout_slack()`. It is fixed when the class is registered,
+ * which keeps the timers of a class in deadline order.
+ * 
+ * Classes live as long as the service, and can not be removed.
+ * 
+ * @param iosvc service to register the class on
+ * @param milliseconds duration of the timers of this class
+ * @param slack how late (in milliseconds) the timers of this class are
+ * allowed to expire, or 0 for exact timers
+ * @param class_id out parameter; gets set to the ID of the new class
+ * @return `EIO_OK` The class has been registered
+ * 
+ * @return `EIO_NOMEM` Could not allocate necessary memory
+ * 
+ * @return `EIO_INVARG` `milliseconds` or `slack` is negative, or `class_id`
+ * is `NULL`
+ */
+io_errcode iosvc_add_timeout_class(io_service *iosvc, int milliseconds,
+                                   int slack, int *class_id);
+
+/**
+ * @brief Same as `iosvc_sched_timeout_op()`, but the timeout is the duration
+ * of the timeout class `class_id` (see `iosvc_add_timeout_class()`)
+ * 
+ * @param iosvc service to execute the handler on
+ * @param event event to await for triggering
+ * @param hnd handler to run
+ * @param status completion status signalled by the service
+ * @param class_id ID of the timeout class
+ * @param remaining out parameter; gets set to the remaining time until
+ * timeout when the handler is called. Must live at least until then.
+ * Ignored if `NULL`
+ * @param op out parameter; handle to the scheduled operation. Only valid if
+ * `EIO_OK` is returned. No handle is produced if `NULL`
+ * @return Same as `iosvc_sched_timeout()`. `EIO_INVARG` is also returned if
+ * `class_id` does not refer to a timeout class of this service
+ */
+io_errcode iosvc_sched_class_timeout(io_service *iosvc, io_event event,
+                                     io_handler hnd, io_errcode *status,
+                                     int class_id, int *remaining,
+                                     io_op_handle *op);
+
+/**
+ * @brief Same as `iosvc_post_delay_op()`, but the delay is the duration of
+ * the timeout class `class_id` (see `iosvc_add_timeout_class()`)
+ * 
+ * @param iosvc service to execute the handler on
+ * @param hnd handler to run
+ * @param status completion status signalled by the service
+ * @param class_id ID of the timeout class
+ * @param op out parameter; handle to the delayed handler. Only valid if
+ * `EIO_OK` is returned. No handle is produced if `NULL`
+ * @return Same as `iosvc_post_delay()`. `EIO_INVARG` is also returned if
+ * `class_id` does not refer to a timeout class of this service
+ */
+io_errcode iosvc_post_class_delay(io_service *iosvc, io_handler hnd,
+                                  io_errcode *status, int class_id,
+                                  io_op_handle *op);
+
+/**
+ * @brief Enables or disables busy-polling. While enabled, the event loop
+ * does not block right away when waiting for events. It first re-checks
+ * readiness with zero-timeout polls, for a window of at most `max_spin_us`
+ * microseconds, sparing the cost of sleeping and waking up if an event
+ * arrives meanwhile. This trades CPU time for latency.
+ * 
+ * The window adapts to recent idle gaps (i.e. how long the loop waited for
+ * events): it is about twice their average, so that it is cut short while
+ * events arrive quickly, and spinning is skipped entirely while they arrive
+ * later than `max_spin_us`. Spinning never delays timers.
+ * 
+ * Busy-polling is disabled by default.
+ * 
+ * @param iosvc service to configure
+ * @param max_spin_us maximum spin window, in microseconds, or 0 to disable
+ * busy-polling
+ * @return `EIO_OK` The setting has been applied
+ * 
+ * @return `EIO_INVARG` `max_spin_us` is negative
+ */
+io_errcode iosvc_set_busy_poll(io_service *iosvc, int max_spin_us);
+
+/**
+ * @brief Gets the time spent by the service spinning and blocked while
+ * waiting for events, while busy-polling was enabled
+ * 
+ * @param iosvc service to query
+ * @param stats out parameter; gets filled with the statistics accumulated
+ * since the service was created
+ */
+void iosvc_get_poll_stats(io_service *iosvc, io_poll_stats *stats);
+
+/**
+ * @brief Sets the priority of a file descriptor. When several file
+ * descriptors are ready in the same iteration of the event loop, handlers of
+ * those with higher priority are called first, so that e.g. health checks
+ * are served before bulk transfers. The setting persists across event
+ * registrations, until changed.
+ * 
+ * File descriptors have priority `IO_PRIO_NORMAL` by default. If no file
+ * descriptor has another priority, no priority lookups are performed.
+ * 
+ * Under an event budget (see `iosvc_set_budget()`), lower priorities are
+ * not starved by busy file descriptors of higher priority: at least one
+ * ready file descriptor of each priority is served per iteration.
+ * 
+ * @param iosvc service to configure
+ * @param fd file descriptor to configure
+ * @param prio priority of `fd`
+ * @return `EIO_OK` The priority has been set
+ * 
+ * @return `EIO_NOMEM` Could not allocate necessary memory
+ * 
+ * @return `EIO_INVARG` `prio` is not a valid priority
+ */
+io_errcode iosvc_set_fd_priority(io_service *iosvc, int fd, io_priority prio);
+
+/**
+ * @brief Enables or disables automatic write coalescing ("auto-cork") for a
+ * file descriptor.
+ * 
+ * While enabled, writes issued on `fd` via `async_write()` and
+ * `async_write_some()` are not performed immediately. They are accumulated
+ * during the current iteration of the event loop, and flushed together with
+ * a single `writev()` call after all ready handlers were dispatched, before
+ * the loop waits for new events. Any number of writes may be pending on an
+ * auto-corked file descriptor at once; they are written in issue order.
+ * 
+ * A write's completion handler is called once all of its bytes have been
+ * flushed. If the file descriptor can not take all the data, the remainder
+ * is flushed when it becomes writable again.
+ * 
+ * Disabling auto-cork does not affect writes that are already pending, which
+ * are still flushed in order before any write issued afterwards.
+ * 
+ * Writes with a deadline (see `async_write_deadline()`) are rejected with
+ * `EIO_INVARG` while writes on `fd` are corked, i.e. while auto-cork is
+ * enabled or corked writes are still pending.
+ * 
+ * When the service stops, queued writes are flushed one last time, and
+ * those that can not be written entirely complete with `EIO_STOPPED`. Writes
+ * still queued when the service is deleted are dropped without calling
+ * their handlers.
+ * 
+ * @param iosvc service to configure
+ * @param fd file descriptor to configure. Should be non-blocking
+ * @param enable nonzero to enable auto-cork, zero to disable it
+ * @return `EIO_OK` The setting has been applied
+ * 
+ * @return `EIO_NOMEM` Could not allocate necessary memory
+ */
+io_errcode iosvc_set_autocork(io_service *iosvc, int fd, int enable);
+
+/**
+ * @brief Flags or unflags a file descriptor as a listener, i.e. a source of
+ * new work, such as a listening socket. Listeners are closed to new events
+ * while the service is draining (see `iosvc_drain()`). The setting persists
+ * across event registrations, until changed.
+ * 
+ * @param iosvc service to configure
+ * @param fd file descriptor to configure
+ * @param enable nonzero to flag `fd` as a listener, zero to unflag it
+ * @return `EIO_OK` The setting has been applied
+ * 
+ * @return `EIO_NOMEM` Could not allocate necessary memory
+ */
+io_errcode iosvc_set_listener(io_service *iosvc, int fd, int enable);
+
+/**
+ * @brief Adds a prepare hook, called at each iteration of the event loop
+ * after the posted handlers were run, just before auto-corked writes are
+ * flushed and the loop waits for events. Work batched by the handlers of an
+ * iteration (e.g. log records, writes) can thus be committed once per
+ * iteration, rather than once per event.
+ * 
+ * Hooks (prepare, check and idle ones) are kept until removed via
+ * `iosvc_remove_hook()`, and are called in the order they were added. They do
+ * not keep the event loop running by themselves: `iosvc_run()` returns once
+ * no other work is pending. Hooks may post and schedule handlers as usual.
+ * A hook added by a hook of the same kind is first called on the next
+ * iteration. A hook removed by a hook is not called anymore, even if its
+ * turn in the current iteration has not come yet.
+ * 
+ * @param iosvc service to add the hook to
+ * @param hnd hook to add
+ * @return `EIO_OK` The hook has been added
+ * 
+ * @return `EIO_NOMEM` Could not allocate necessary memory
+ * 
+ * @return `EIO_INVARG` The supplied handler's callback function is `NULL`
+ */
+io_errcode iosvc_add_prepare_hook(io_service *iosvc, io_handler hnd);
+
+/**
+ * @brief Adds a check hook, called at each iteration of the event loop right
+ * after the handlers of expired timers and ready events were dispatched, e.g.
+ * to process work collected by those handlers at once. See
+ * `iosvc_add_prepare_hook()` for details
+ * 
+ * @param iosvc service to add the hook to
+ * @param hnd hook to add
+ * @return Same as `iosvc_add_prepare_hook()`
+ */
+io_errcode iosvc_add_check_hook(io_service *iosvc, io_handler hnd);
+
+/**
+ * @brief Adds an idle hook, called at the iterations of the event loop that
+ * have nothing to do right away, i.e. with no posted handlers, no timers due
+ * and no writes to flush, before prepare hooks. The loop would otherwise
+ * wait for events, so idle hooks suit low priority work, such as refilling
+ * pools. Anything they post or schedule is taken into account by the wait.
+ * See `iosvc_add_prepare_hook()` for details
+ * 
+ * @param iosvc service to add the hook to
+ * @param hnd hook to add
+ * @return Same as `iosvc_add_prepare_hook()`
+ */
+io_errcode iosvc_add_idle_hook(io_service *iosvc, io_handler hnd);
+
+/**
+ * @brief Removes a hook added by `iosvc_add_prepare_hook()`,
+ * `iosvc_add_check_hook()` or `iosvc_add_idle_hook()`. A hook added several
+ * times (or as several kinds of hook) is removed once from each kind
+ * 
+ * @param iosvc service to remove the hook from
+ * @param hnd hook to remove, compared by both callback and context
+ * @return `EIO_OK` The hook has been removed
+ * 
+ * @return `EIO_NOENTRY` No such hook was found
+ */
+io_errcode iosvc_remove_hook(io_service *iosvc, io_handler hnd);
+
 #endif // IO_SERVICE_H_
@@ -1,6 +1,9 @@
 #ifndef IOTYPES_H_
 #define IOTYPES_H_ 1
 
+#include <stddef.h>
+#include <stdint.h>
+
 /**
  * @brief Wait type to be associated with a file descriptor in an event.
  * consists of `WAIT_READ`, to signal read-related events (fd readable, EOF),
@@ -44,6 +47,19 @@ typedef enum
     EIO_EOF
 } io_errcode;
 
+/**
+ * @brief Priority of posted handlers and of file descriptors. Work of higher
+ * priority is always served first by the event loop, e.g. so that
+ * control-plane traffic is not delayed by bulk transfers. `IO_PRIO_NORMAL` is
+ * the default
+ */
+typedef enum
+{
+    IO_PRIO_HIGH,
+    IO_PRIO_NORMAL,
+    IO_PRIO_LOW
+} io_priority;
+
 /**
  * @brief Aggregate between a file descriptor and a `io_wait_type`. Passed to
  * `iosvc_sched()` and `iosvc_sched_timed()` to schedule a callback upon an
@@ -72,6 +88,36 @@ typedef struct {
     void *ctx;
 } io_handler;
 
+/**
+ * @brief Lightweight handle to a scheduled operation, optionally produced by
+ * the `iosvc_XXX_op()` scheduling functions and used to cancel that specific
+ * operation via `iosvc_cancel_op()`.
+ * 
+ * Handles are generation-checked: once the operation completes (or is
+ * cancelled), its handle becomes stale and is safely rejected. A
+ * zero-initialized handle never refers to an operation.
+ */
+typedef struct {
+    uint32_t idx;
+    uint32_t gen;
+} io_op_handle;
+
+/**
+ * @brief Memory allocator of a service, used for all memory owned by the
+ * service (see `iosvc_create_with_allocator()`).
+ * 
+ * Consists of `alloc`, called to allocate `size` bytes aligned to `align` (a
+ * power of 2), returning `NULL` on failure, `free`, called to release a block
+ * returned by `alloc` along with the size it was requested with, and `ctx`,
+ * passed as first argument to both, e.g. an arena or a memory accounting
+ * structure
+ */
+typedef struct {
+    void *(*alloc)(void *ctx, size_t size, size_t align);
+    void (*free)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+} io_allocator;
+
 /**
  * @brief Converts an error code to a human-readable C-string
  * 
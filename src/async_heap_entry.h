@@ -4,16 +4,20 @@
 #include <stdint.h>
 
 #include "rbnode.h"
+#include "dheap.h"
 
 typedef struct async_heap_entry {
-    int64_t deadline;
-    int *remaining;
+    int *remaining; // NULL for absolute deadlines
     rb_node *io_op_data;
     io_wait_type event_type;
 } async_heap_entry;
 
-int async_hp_ent_lt(const void *ent1, const void *ent2);
+inline static void async_hp_ent_moved(async_heap_entry *ent, size_t idx) {
+    get_evt_data(ent->io_op_data, ent->event_type)->ddl_heap_idx =
+        (ptrdiff_t)idx;
+}
 
-void async_hp_ent_swp(void *ent1, void *ent2);
+// Deadlines of async events
+DHEAP_DEFINE(async_heap, async_heap_entry, async_hp_ent_moved)
 
 #endif // IO_ASYNC_HEAP_ENTRY_H_
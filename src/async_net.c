@@ -1,79 +1,137 @@
 #include "async_net.h"
 
-#include <stdlib.h>
 #include <fcntl.h>
 #include <errno.h>
 
-typedef struct {
-    int listen_sock;
-    struct sockaddr *addr;
-    socklen_t *addrlen;
-    io_handler hnd;
-    int *new_sock;
-    io_errcode *errc;
-} accept_ctx;
-
-typedef struct {
-    int sockfd;
-    io_handler hnd;
-    io_errcode *errc;
-} conn_ctx;
+#include "iosvc_def.h"
+
+/**
+ * @brief Complete an accept or connect. The operation is released before the
+ * handler runs, if it was allocated by the scheduling call
+ * 
+ * @param op operation to complete
+ */
+static void net_complete(io_op *op) {
+    io_handler hnd = op->hnd;
+
+    if (op->allocated)
+        iomem_free(&op->iosvc->allocator, op, sizeof(*op));
+
+    hnd.callback(hnd.ctx);
+}
+
+/**
+ * @brief Schedule the completion of an accept or connect, optionally bounded
+ * by a timeout
+ * 
+ * @param iosvc service to schedule on
+ * @param event event to await
+ * @param hnd handler completing the operation
+ * @param errc completion status
+ * @param remaining in-out timeout storage (in milliseconds), or `NULL` if the
+ * operation is not timed
+ * @return Status of the scheduling call
+ */
+static io_errcode net_sched(io_service *iosvc, io_event event, io_handler hnd,
+                            io_errcode *errc, int *remaining) {
+    if (!remaining)
+        return iosvc_sched(iosvc, event, hnd, errc);
+
+    return iosvc_sched_timeout(iosvc, event, hnd, errc, remaining);
+}
 
 static void connect_impl(void *arg) {
-    conn_ctx *ctx = (conn_ctx *)arg;
+    io_op *op = (io_op *)arg;
 
-    if (*ctx->errc == EIO_OK) {
+    if (*op->errc == EIO_OK) {
         int conn_rc;
         socklen_t optlen = sizeof(conn_rc);
 
-        if (getsockopt(ctx->sockfd, SOL_SOCKET, SO_ERROR,
+        if (getsockopt(op->fd, SOL_SOCKET, SO_ERROR,
                        &conn_rc, &optlen) || conn_rc)
-            *ctx->errc = EIO_SYSERR;
+            *op->errc = EIO_SYSERR;
+    } else if (*op->errc == EIO_TIMEOUT) {
+        // Abort the pending handshake, so that the connection is not
+        // established behind the caller's back
+        struct sockaddr unspec = {.sa_family = AF_UNSPEC};
+        (void)connect(op->fd, &unspec, sizeof(unspec));
     }
     
-    ctx->hnd.callback(ctx->hnd.ctx);
-    free(ctx);
+    net_complete(op);
 }
 
 static void accept_impl(void *arg) {
-    accept_ctx *ctx = (accept_ctx *)arg;
+    io_op *op = (io_op *)arg;
 
-    if (*ctx->errc == EIO_OK) {
-        *ctx->new_sock = accept(ctx->listen_sock, ctx->addr, ctx->addrlen);
+    if (*op->errc == EIO_OK) {
+        *op->acc.new_sock = accept(op->fd, op->acc.addr, op->acc.addrlen);
 
-        if (*ctx->new_sock < 0)
-            *ctx->errc = EIO_SYSERR;
+        if (*op->acc.new_sock < 0)
+            *op->errc = EIO_SYSERR;
+    } else {
+        *op->acc.new_sock = -1;
     }
     
-    ctx->hnd.callback(ctx->hnd.ctx);
-    free(ctx);
+    net_complete(op);
 }
 
-io_errcode async_accept(io_service *iosvc, int listen_sock,
-                        struct sockaddr *addr, socklen_t *addrlen,
-                        io_handler hnd, int *new_sock, io_errcode *errc) {
-    accept_ctx *ctx = (accept_ctx *)malloc(sizeof(*ctx));
-    if (!ctx)
-        return EIO_NOMEM;
+/**
+ * @brief Schedule an accept
+ * 
+ * @param op storage of the operation, or `NULL` to allocate it
+ * @param milliseconds timeout of the operation, or -1 for none
+ * @return Same as `async_accept_timeout()`
+ */
+static io_errcode accept_sched(io_op *op, io_service *iosvc, int listen_sock,
+                               struct sockaddr *addr, socklen_t *addrlen,
+                               io_handler hnd, int *new_sock, io_errcode *errc,
+                               int milliseconds) {
+    int allocated = (op == NULL);
 
-    *ctx = (accept_ctx){
-        .addr = addr,
-        .addrlen = addrlen,
-        .errc = errc,
+    if (allocated) {
+        op = (io_op *)iomem_alloc(&iosvc->allocator, sizeof(*op),
+                                  _Alignof(io_op));
+        if (!op)
+            return EIO_NOMEM;
+    }
+
+    *op = (io_op){
+        .iosvc = iosvc,
         .hnd = hnd,
-        .listen_sock = listen_sock,
-        .new_sock = new_sock
+        .errc = errc,
+        .fd = listen_sock,
+        .allocated = allocated,
+        .remaining = milliseconds,
+        .acc = {
+            .addr = addr,
+            .addrlen = addrlen,
+            .new_sock = new_sock
+        }
     };
 
-    return iosvc_sched(iosvc, 
-                       (io_event){.fd = listen_sock, .wait_type = WAIT_READ},
-                       (io_handler){accept_impl, ctx},
-                       errc);
+    io_errcode sched_errc =
+        net_sched(iosvc,
+                  (io_event){.fd = listen_sock, .wait_type = WAIT_READ},
+                  (io_handler){accept_impl, op},
+                  errc, milliseconds < 0 ? NULL : &op->remaining);
+
+    if (sched_errc && allocated)
+        iomem_free(&iosvc->allocator, op, sizeof(*op));
+
+    return sched_errc;
 }
 
-io_errcode async_connect(io_service *iosvc, int sockfd,
-                         struct sockaddr const *addr, socklen_t addrlen,
-                         io_handler hnd, io_errcode *errc) {
+/**
+ * @brief Initiate a connection
+ * 
+ * @param op storage of the operation, or `NULL` to allocate it
+ * @param milliseconds timeout of the operation, or -1 for none
+ * @return Same as `async_connect_timeout()`
+ */
+static io_errcode connect_sched(io_op *op, io_service *iosvc, int sockfd,
+                                struct sockaddr const *addr,
+                                socklen_t addrlen, io_handler hnd,
+                                io_errcode *errc, int milliseconds) {
     // Set as nonblocking
     int rc = fcntl(sockfd, F_GETFL, 0);
     if (rc == -1)
@@ -82,24 +140,111 @@ io_errcode async_connect(io_service *iosvc, int sockfd,
     if (rc == -1)
         return EIO_SYSERR;
     
-    conn_ctx *ctx = (conn_ctx *)malloc(sizeof(*ctx));
-    if (!ctx)
-        return EIO_NOMEM;
+    int allocated = (op == NULL);
+
+    if (allocated) {
+        op = (io_op *)iomem_alloc(&iosvc->allocator, sizeof(*op),
+                                  _Alignof(io_op));
+        if (!op)
+            return EIO_NOMEM;
+    }
     
-    *ctx = (conn_ctx){
-        .errc = errc,
+    *op = (io_op){
+        .iosvc = iosvc,
         .hnd = hnd,
-        .sockfd = sockfd
+        .errc = errc,
+        .fd = sockfd,
+        .allocated = allocated,
+        .remaining = milliseconds
     };
 
     rc = connect(sockfd, addr, addrlen);
     if (rc == -1 && errno != EINPROGRESS) {
-        free(ctx);
+        if (allocated)
+            iomem_free(&iosvc->allocator, op, sizeof(*op));
+
         return EIO_SYSERR;
     }
 
-    return iosvc_sched(iosvc, 
-                       (io_event){.fd = sockfd, .wait_type = WAIT_WRITE},
-                       (io_handler){connect_impl, ctx},
-                       errc);
+    io_errcode sched_errc =
+        net_sched(iosvc,
+                  (io_event){.fd = sockfd, .wait_type = WAIT_WRITE},
+                  (io_handler){connect_impl, op},
+                  errc, milliseconds < 0 ? NULL : &op->remaining);
+
+    if (sched_errc && allocated)
+        iomem_free(&iosvc->allocator, op, sizeof(*op));
+
+    return sched_errc;
+}
+
+io_errcode async_accept(io_service *iosvc, int listen_sock,
+                        struct sockaddr *addr, socklen_t *addrlen,
+                        io_handler hnd, int *new_sock, io_errcode *errc) {
+    return accept_sched(NULL, iosvc, listen_sock, addr, addrlen, hnd,
+                        new_sock, errc, -1);
+}
+
+io_errcode async_accept_timeout(io_service *iosvc, int listen_sock,
+                                struct sockaddr *addr, socklen_t *addrlen,
+                                io_handler hnd, int *new_sock,
+                                io_errcode *errc, int milliseconds) {
+    if (milliseconds < 0)
+        return EIO_INVARG;
+
+    return accept_sched(NULL, iosvc, listen_sock, addr, addrlen, hnd,
+                        new_sock, errc, milliseconds);
+}
+
+io_errcode async_connect(io_service *iosvc, int sockfd,
+                         struct sockaddr const *addr, socklen_t addrlen,
+                         io_handler hnd, io_errcode *errc) {
+    return connect_sched(NULL, iosvc, sockfd, addr, addrlen, hnd, errc, -1);
+}
+
+io_errcode async_connect_timeout(io_service *iosvc, int sockfd,
+                                 struct sockaddr const *addr,
+                                 socklen_t addrlen, io_handler hnd,
+                                 io_errcode *errc, int milliseconds) {
+    if (milliseconds < 0)
+        return EIO_INVARG;
+
+    return connect_sched(NULL, iosvc, sockfd, addr, addrlen, hnd, errc,
+                         milliseconds);
+}
+
+io_errcode async_accept_op(io_op *op, io_service *iosvc, int listen_sock,
+                           struct sockaddr *addr, socklen_t *addrlen,
+                           io_handler hnd, int *new_sock, io_errcode *errc) {
+    return accept_sched(op, iosvc, listen_sock, addr, addrlen, hnd, new_sock,
+                        errc, -1);
+}
+
+io_errcode async_accept_timeout_op(io_op *op, io_service *iosvc,
+                                   int listen_sock, struct sockaddr *addr,
+                                   socklen_t *addrlen, io_handler hnd,
+                                   int *new_sock, io_errcode *errc,
+                                   int milliseconds) {
+    if (milliseconds < 0)
+        return EIO_INVARG;
+
+    return accept_sched(op, iosvc, listen_sock, addr, addrlen, hnd, new_sock,
+                        errc, milliseconds);
+}
+
+io_errcode async_connect_op(io_op *op, io_service *iosvc, int sockfd,
+                            struct sockaddr const *addr, socklen_t addrlen,
+                            io_handler hnd, io_errcode *errc) {
+    return connect_sched(op, iosvc, sockfd, addr, addrlen, hnd, errc, -1);
+}
+
+io_errcode async_connect_timeout_op(io_op *op, io_service *iosvc, int sockfd,
+                                    struct sockaddr const *addr,
+                                    socklen_t addrlen, io_handler hnd,
+                                    io_errcode *errc, int milliseconds) {
+    if (milliseconds < 0)
+        return EIO_INVARG;
+
+    return connect_sched(op, iosvc, sockfd, addr, addrlen, hnd, errc,
+                         milliseconds);
 }
@@ -1,124 +1,255 @@
 #include "async_rdwr.h"
 
 #include <unistd.h>
-#include <stdlib.h>
-
-typedef struct {
-    io_service *iosvc;
-    io_handler hnd;
-    void *buf;
-    size_t nbytes;
-    size_t *transferred;
-    io_errcode *errc;
-    int fd;
-    io_wait_type op_type;
-} rw_ctx;
+
+#include "iosvc_def.h"
+#include "iosvc_cork.h"
+#include "heaputils.h"
+
+/**
+ * @brief Call the completion handler of an operation, releasing its storage
+ * first if it was allocated here, as the handler may reuse or release
+ * caller-provided storage
+ * 
+ * @param op operation to complete
+ */
+static void rw_complete(io_op *op) {
+    io_handler hnd = op->hnd;
+
+    if (op->allocated)
+        iomem_free(&op->iosvc->allocator, op, sizeof(*op));
+
+    hnd.callback(hnd.ctx);
+}
+
+/**
+ * @brief Schedule the next transfer of an operation, bounded by the
+ * operation's deadline if it has one
+ * 
+ * @param op operation
+ * @param impl_callback callback performing the transfer
+ * @return Status of the scheduling call
+ */
+static io_errcode rw_arm(io_op *op, void (*impl_callback)(void *)) {
+    io_event event = {op->fd, op->op_type};
+    io_handler hnd = {impl_callback, op};
+
+    if (op->deadline < 0)
+        return iosvc_sched(op->iosvc, event, hnd, op->errc);
+
+    return iosvc_sched_until(op->iosvc, event, hnd, op->errc, op->deadline,
+                             NULL);
+}
 
 static void rw_some_impl(void *arg) {
-    rw_ctx *ctx = (rw_ctx *)arg;
+    io_op *op = (io_op *)arg;
 
-    if (*ctx->errc == EIO_OK) {
-        ssize_t bytes_transferred = ctx->op_type == WAIT_READ ?
-            read(ctx->fd, ctx->buf, ctx->nbytes) :
-            write(ctx->fd, ctx->buf, ctx->nbytes);
+    if (*op->errc == EIO_OK) {
+        ssize_t bytes_transferred = op->op_type == WAIT_READ ?
+            read(op->fd, op->rw.buf, op->rw.nbytes) :
+            write(op->fd, op->rw.buf, op->rw.nbytes);
 
         if (bytes_transferred < 0) {
-            *ctx->errc = EIO_SYSERR;
-            *ctx->transferred = 0;
+            *op->errc = EIO_SYSERR;
+            *op->rw.transferred = 0;
         } else {
-            *ctx->transferred = (size_t)bytes_transferred;
+            *op->rw.transferred = (size_t)bytes_transferred;
         }
     }
 
-    ctx->hnd.callback(ctx->hnd.ctx);
-    free(ctx);
+    rw_complete(op);
 }
 
 static void rw_impl(void *arg) {
-    rw_ctx *ctx = (rw_ctx *)arg;
+    io_op *op = (io_op *)arg;
 
-    if (*ctx->errc == EIO_OK) {
-        ssize_t bytes_transferred = ctx->op_type == WAIT_READ ?
-            read(ctx->fd, ctx->buf, ctx->nbytes) :
-            write(ctx->fd, ctx->buf, ctx->nbytes);
+    if (*op->errc == EIO_OK) {
+        ssize_t bytes_transferred = op->op_type == WAIT_READ ?
+            read(op->fd, op->rw.buf, op->rw.nbytes) :
+            write(op->fd, op->rw.buf, op->rw.nbytes);
         
         if (bytes_transferred <= 0) {
-            *ctx->errc = bytes_transferred == 0 ? EIO_EOF : EIO_SYSERR;
+            *op->errc = bytes_transferred == 0 ? EIO_EOF : EIO_SYSERR;
         } else {
-            *ctx->transferred += (size_t)bytes_transferred;
-            ctx->nbytes -= (size_t)bytes_transferred;
-            ctx->buf = (char *)ctx->buf + bytes_transferred;
+            *op->rw.transferred += (size_t)bytes_transferred;
+            op->rw.nbytes -= (size_t)bytes_transferred;
+            op->rw.buf = (char *)op->rw.buf + bytes_transferred;
 
             // Check if there is more to transfer
-            if (ctx->nbytes > 0) {
-                io_errcode errc =
-                    iosvc_sched(ctx->iosvc,
-                                (io_event){ctx->fd, ctx->op_type},
-                                (io_handler){rw_impl, arg},
-                                ctx->errc);
-            
+            if (op->rw.nbytes > 0) {
+                io_errcode errc = rw_arm(op, rw_impl);
+
                 if (errc)
-                    *ctx->errc = errc;
+                    *op->errc = errc;
                 else
                     return;
             }
         }
     }
 
-    ctx->hnd.callback(ctx->hnd.ctx);
-    free(ctx);
+    rw_complete(op);
 }
 
-static io_errcode async_rw_sched(io_service *iosvc, int fd, void *buf,
-                          size_t nbytes, io_handler const *hnd,
-                          size_t *transferred, io_errcode *errc,
-                          io_wait_type op_type, void (*impl_callback)(void *)) {
-    rw_ctx *ctx = (rw_ctx *)malloc(sizeof(*ctx));
-    if (!ctx)
-        return EIO_NOMEM;
+/**
+ * @brief Schedule a read or write
+ * 
+ * @param op storage of the operation, or `NULL` to allocate it
+ * @param deadline absolute deadline of the operation, or -1 for none
+ * @return Same as `async_read()`
+ */
+static io_errcode async_rw_sched(io_op *op, io_service *iosvc, int fd,
+                                 void *buf, size_t nbytes,
+                                 io_handler const *hnd, size_t *transferred,
+                                 io_errcode *errc, io_wait_type op_type,
+                                 void (*impl_callback)(void *),
+                                 int64_t deadline) {
+    if (op_type == WAIT_WRITE) {
+        // Deadline-bound writes can not wait behind corked data, and would
+        // reorder the stream if written ahead of it
+        if (deadline >= 0) {
+            if (iosvc_is_corked(iosvc, fd))
+                return EIO_INVARG;
+        } else {
+            io_errcode cork_errc = iosvc_cork_write(iosvc, fd, buf, nbytes,
+                                                    hnd, transferred, errc);
+
+            if (cork_errc != EIO_NOENTRY)
+                return cork_errc;
+        }
+    }
+
+    int allocated = (op == NULL);
+
+    if (allocated) {
+        op = (io_op *)iomem_alloc(&iosvc->allocator, sizeof(*op),
+                                  _Alignof(io_op));
+        if (!op)
+            return EIO_NOMEM;
+    }
     
-    *ctx = (rw_ctx){
+    *op = (io_op){
         .iosvc = iosvc,
-        .buf = buf,
-        .nbytes = nbytes,
         .hnd = *hnd,
         .errc = errc,
         .fd = fd,
-        .transferred = transferred,
-        .op_type = op_type
+        .allocated = allocated,
+        .op_type = op_type,
+        .deadline = deadline,
+        .rw = {
+            .buf = buf,
+            .nbytes = nbytes,
+            .transferred = transferred
+        }
     };
 
     *transferred = 0;
 
-    return iosvc_sched(iosvc, 
-                       (io_event){fd, op_type},
-                       (io_handler){impl_callback, ctx},
-                       errc);
+    io_errcode sched_errc = rw_arm(op, impl_callback);
+    if (sched_errc && allocated)
+        iomem_free(&iosvc->allocator, op, sizeof(*op));
+
+    return sched_errc;
 }
 
 io_errcode async_read_some(io_service *iosvc, int fd, void *buf,
                            size_t nbytes, io_handler hnd,
                            size_t *transferred, io_errcode *errc) {
-    return async_rw_sched(iosvc, fd, buf, nbytes, &hnd, transferred,
-                          errc, WAIT_READ, rw_some_impl);
+    return async_rw_sched(NULL, iosvc, fd, buf, nbytes, &hnd, transferred,
+                          errc, WAIT_READ, rw_some_impl, -1);
 }
 
 io_errcode async_read(io_service *iosvc, int fd, void *buf, size_t nbytes,
                       io_handler hnd, size_t *transferred, io_errcode *errc) {
-    return async_rw_sched(iosvc, fd, buf, nbytes, &hnd, transferred,
-                          errc, WAIT_READ, rw_impl);
+    return async_rw_sched(NULL, iosvc, fd, buf, nbytes, &hnd, transferred,
+                          errc, WAIT_READ, rw_impl, -1);
 }
 
 io_errcode async_write_some(io_service *iosvc, int fd, void const *buf,
                             size_t nbytes, io_handler hnd,
                             size_t *transferred, io_errcode *errc) {
-    return async_rw_sched(iosvc, fd, (void *)buf, nbytes, &hnd, transferred,
-                          errc, WAIT_WRITE, rw_some_impl);
+    return async_rw_sched(NULL, iosvc, fd, (void *)buf, nbytes, &hnd,
+                          transferred, errc, WAIT_WRITE, rw_some_impl, -1);
 }
 
 io_errcode async_write(io_service *iosvc, int fd, void const *buf,
                        size_t nbytes, io_handler hnd, size_t *transferred,
                        io_errcode *errc) {
-    return async_rw_sched(iosvc, fd, (void *)buf, nbytes, &hnd, transferred,
-                          errc, WAIT_WRITE, rw_impl);
+    return async_rw_sched(NULL, iosvc, fd, (void *)buf, nbytes, &hnd,
+                          transferred, errc, WAIT_WRITE, rw_impl, -1);
+}
+
+io_errcode async_read_deadline(io_service *iosvc, int fd, void *buf,
+                               size_t nbytes, io_handler hnd,
+                               size_t *transferred, io_errcode *errc,
+                               int milliseconds) {
+    if (milliseconds < 0)
+        return EIO_INVARG;
+
+    return async_rw_sched(NULL, iosvc, fd, buf, nbytes, &hnd, transferred,
+                          errc, WAIT_READ, rw_impl,
+                          current_time() + milliseconds);
+}
+
+io_errcode async_write_deadline(io_service *iosvc, int fd, void const *buf,
+                                size_t nbytes, io_handler hnd,
+                                size_t *transferred, io_errcode *errc,
+                                int milliseconds) {
+    if (milliseconds < 0)
+        return EIO_INVARG;
+
+    return async_rw_sched(NULL, iosvc, fd, (void *)buf, nbytes, &hnd,
+                          transferred, errc, WAIT_WRITE, rw_impl,
+                          current_time() + milliseconds);
+}
+
+io_errcode async_read_some_op(io_op *op, io_service *iosvc, int fd, void *buf,
+                              size_t nbytes, io_handler hnd,
+                              size_t *transferred, io_errcode *errc) {
+    return async_rw_sched(op, iosvc, fd, buf, nbytes, &hnd, transferred,
+                          errc, WAIT_READ, rw_some_impl, -1);
+}
+
+io_errcode async_read_op(io_op *op, io_service *iosvc, int fd, void *buf,
+                         size_t nbytes, io_handler hnd, size_t *transferred,
+                         io_errcode *errc) {
+    return async_rw_sched(op, iosvc, fd, buf, nbytes, &hnd, transferred,
+                          errc, WAIT_READ, rw_impl, -1);
+}
+
+io_errcode async_write_some_op(io_op *op, io_service *iosvc, int fd,
+                               void const *buf, size_t nbytes, io_handler hnd,
+                               size_t *transferred, io_errcode *errc) {
+    return async_rw_sched(op, iosvc, fd, (void *)buf, nbytes, &hnd,
+                          transferred, errc, WAIT_WRITE, rw_some_impl, -1);
+}
+
+io_errcode async_write_op(io_op *op, io_service *iosvc, int fd,
+                          void const *buf, size_t nbytes, io_handler hnd,
+                          size_t *transferred, io_errcode *errc) {
+    return async_rw_sched(op, iosvc, fd, (void *)buf, nbytes, &hnd,
+                          transferred, errc, WAIT_WRITE, rw_impl, -1);
+}
+
+io_errcode async_read_deadline_op(io_op *op, io_service *iosvc, int fd,
+                                  void *buf, size_t nbytes, io_handler hnd,
+                                  size_t *transferred, io_errcode *errc,
+                                  int milliseconds) {
+    if (milliseconds < 0)
+        return EIO_INVARG;
+
+    return async_rw_sched(op, iosvc, fd, buf, nbytes, &hnd, transferred,
+                          errc, WAIT_READ, rw_impl,
+                          current_time() + milliseconds);
+}
+
+io_errcode async_write_deadline_op(io_op *op, io_service *iosvc, int fd,
+                                   void const *buf, size_t nbytes,
+                                   io_handler hnd, size_t *transferred,
+                                   io_errcode *errc, int milliseconds) {
+    if (milliseconds < 0)
+        return EIO_INVARG;
+
+    return async_rw_sched(op, iosvc, fd, (void *)buf, nbytes, &hnd,
+                          transferred, errc, WAIT_WRITE, rw_impl,
+                          current_time() + milliseconds);
 }
@@ -1,49 +1,78 @@
 #include "cbuffer.h"
 
 #include <memory.h>
-#include <stdlib.h>
+
+#include "iomem.h"
 
 inline static size_t mx(size_t a, size_t b) {
     return a < b ? b : a;
 }
 
-void cbuf_init(cbuffer *cbuf, size_t obj_size) {
+void cbuf_init(cbuffer *cbuf, size_t obj_size, io_allocator const *alc) {
     *cbuf = (cbuffer){.data = NULL,
                       .data_limit = NULL,
                       .nelems = 0,
                       .obj_size = obj_size,
                       .begin = NULL,
-                      .end = NULL};
+                      .end = NULL,
+                      .alc = alc,
+                      .fixed = 0};
 }
 
 void cbuf_delete(cbuffer *cbuf) {
-    free(cbuf->data);
+    iomem_free(cbuf->alc, cbuf->data,
+               (size_t)(cbuf->data_limit - cbuf->data));
+}
+
+/**
+ * @brief Move the elements of a buffer to a new allocation of `new_size`
+ * bytes, which must fit all of them. Elements are moved to the start of the
+ * new allocation, in order
+ * 
+ * @return 0 on success, -1 if no memory could be allocated
+ */
+static int cbuf_realloc(cbuffer *cbuf, size_t new_size) {
+    char *new_data = NULL;
+
+    if (new_size) {
+        new_data = (char *)iomem_alloc(cbuf->alc, new_size,
+                                       _Alignof(max_align_t));
+        if (!new_data)
+            return -1;
+    }
+
+    size_t used = cbuf->nelems * cbuf->obj_size;
+
+    if (used) {
+        // Elements wrap around the end of the buffer unless they are stored
+        // in a single run
+        size_t fst_copy_size = (cbuf->begin < cbuf->end) ?
+            used : (size_t)(cbuf->data_limit - cbuf->begin);
+
+        memcpy(new_data, cbuf->begin, fst_copy_size);
+        memcpy(new_data + fst_copy_size, cbuf->data, used - fst_copy_size);
+    }
+
+    cbuf_delete(cbuf);
+
+    cbuf->data = cbuf->begin = new_data;
+    cbuf->data_limit = new_data ? new_data + new_size : NULL;
+    cbuf->end = (new_data && used < new_size) ? new_data + used : new_data;
+
+    return 0;
 }
 
 void *cbuf_push(cbuffer *cbuf) {
     if (!cbuf->data || ((cbuf->begin == cbuf->end) && cbuf->nelems != 0)) {
+        if (cbuf->fixed)
+            return NULL;
+
         // resize the buffer
         size_t new_capacity =
             mx(cbuf->obj_size, 2u * (size_t)(cbuf->data_limit - cbuf->data));
-        char *new_data = (char *)malloc(new_capacity);
 
-        if (!new_data)
+        if (cbuf_realloc(cbuf, new_capacity) < 0)
             return NULL;
-
-        size_t fst_copy_size = (size_t)(cbuf->data_limit - cbuf->begin);
-        size_t scd_copy_size = (size_t)(cbuf->end - cbuf->data);
-
-        if (fst_copy_size)
-            memmove(new_data, cbuf->begin, fst_copy_size);
-        if (scd_copy_size)
-            memmove(new_data + fst_copy_size, cbuf->data, scd_copy_size);
-
-        free(cbuf->data);
-
-        cbuf->data = new_data;
-        cbuf->data_limit = new_data + new_capacity;
-        cbuf->begin = new_data;
-        cbuf->end = new_data + fst_copy_size + scd_copy_size;
     }
 
     void *retval = cbuf->end;
@@ -55,3 +84,32 @@ void *cbuf_push(cbuffer *cbuf) {
 
     return retval;
 }
+
+int cbuf_make_fixed(cbuffer *cbuf, size_t capacity) {
+    if (capacity < cbuf->nelems ||
+        cbuf_realloc(cbuf, capacity * cbuf->obj_size) < 0)
+        return -1;
+
+    cbuf->fixed = 1;
+    return 0;
+}
+
+int cbuf_reserve(cbuffer *cbuf, size_t capacity) {
+    if (capacity <= cbuf_capacity(cbuf))
+        return 0;
+
+    if (cbuf->fixed)
+        return -1;
+
+    return cbuf_realloc(cbuf, capacity * cbuf->obj_size);
+}
+
+int cbuf_shrink(cbuffer *cbuf, size_t capacity) {
+    if (capacity < cbuf->nelems)
+        capacity = cbuf->nelems;
+
+    if (cbuf->fixed || capacity >= cbuf_capacity(cbuf))
+        return 0;
+
+    return cbuf_realloc(cbuf, capacity * cbuf->obj_size);
+}
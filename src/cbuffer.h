@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 
+#include "iotypes.h"
+
 typedef struct cbuffer {
     char *data;
     char *data_limit;
@@ -10,18 +12,49 @@ typedef struct cbuffer {
     size_t obj_size;
     char *begin;
     char *end;
+    io_allocator const *alc;
+    int fixed; // Capacity may not change anymore
 } cbuffer;
 
-void cbuf_init(cbuffer *cbuf, size_t obj_size);
+void cbuf_init(cbuffer *cbuf, size_t obj_size, io_allocator const *alc);
 
 void cbuf_delete(cbuffer *cbuf);
 
 void *cbuf_push(cbuffer *cbuf);
 
+/**
+ * @brief Allocate room for `capacity` elements in an empty buffer, and
+ * disable any further reallocation. Once full, the buffer can not grow
+ * anymore
+ * 
+ * @return 0 on success, -1 if no memory could be allocated
+ */
+int cbuf_make_fixed(cbuffer *cbuf, size_t capacity);
+
+/**
+ * @brief Grow the buffer to room for at least `capacity` elements
+ * 
+ * @return 0 on success, -1 if no memory could be allocated, or if the buffer
+ * has fixed capacity
+ */
+int cbuf_reserve(cbuffer *cbuf, size_t capacity);
+
+/**
+ * @brief Shrink the buffer to room for `capacity` elements, or for all its
+ * elements if it holds more. Buffers with fixed capacity are left untouched
+ * 
+ * @return 0 on success, -1 if no memory could be allocated
+ */
+int cbuf_shrink(cbuffer *cbuf, size_t capacity);
+
 inline static size_t cbuf_size(cbuffer const *cbuf) {
     return cbuf->nelems;
 }
 
+inline static size_t cbuf_capacity(cbuffer const *cbuf) {
+    return (size_t)(cbuf->data_limit - cbuf->data) / cbuf->obj_size;
+}
+
 inline static int cbuf_empty(cbuffer const *cbuf) {
     return cbuf->nelems == 0;
 }
@@ -30,6 +63,14 @@ inline static void *cbuf_front(cbuffer *cbuf) {
     return cbuf->begin;
 }
 
+inline static void *cbuf_at(cbuffer *cbuf, size_t idx) {
+    size_t offset = idx * cbuf->obj_size;
+    size_t until_limit = (size_t)(cbuf->data_limit - cbuf->begin);
+
+    return offset < until_limit ? cbuf->begin + offset :
+                                  cbuf->data + (offset - until_limit);
+}
+
 inline static void cbuf_pop(cbuffer *cbuf) {
     --cbuf->nelems;
     cbuf->begin += cbuf->obj_size;
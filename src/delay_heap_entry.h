@@ -4,15 +4,24 @@
 #include <stdint.h>
 
 #include "iotypes.h"
+#include "dheap.h"
 
 typedef struct delay_heap_entry {
-    int64_t deadline;
     io_handler handler;
     io_errcode *status;
+    int64_t period; // 0 if not periodic
+    int64_t due;    // Nominal deadline, before applying slack
+    int slack;
+    uint32_t op_slot; // Handle slot, if a handle was requested
 } delay_heap_entry;
 
-int delay_hp_ent_lt(const void *ent1, const void *ent2);
+// Positions of delayed handlers are not tracked
+inline static void delay_hp_ent_moved(delay_heap_entry *ent, size_t idx) {
+    (void)ent;
+    (void)idx;
+}
 
-void delay_hp_ent_swp(void *ent1, void *ent2);
+// Deadlines of delayed handlers
+DHEAP_DEFINE(delay_heap, delay_heap_entry, delay_hp_ent_moved)
 
 #endif // IO_DELAY_HEAP_ENTRY_H_
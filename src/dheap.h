@@ -0,0 +1,216 @@
+#ifndef IO_DHEAP_H_
+#define IO_DHEAP_H_ 1
+
+// Generator of min-heaps of timers, specialized per entry type, so that
+// comparisons and moves are inlined instead of going through callbacks.
+//
+// Deadlines are kept in an array of their own, next to the entries, so that
+// comparisons only touch deadlines, which are contiguous. Heaps are 4-ary:
+// half as deep as binary ones, with all children of a node adjacent.
+// Sifting moves a hole instead of swapping, so each moved entry is copied
+// once per level.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "iomem.h"
+
+#define DHEAP_ARITY 4
+
+/**
+ * @brief Define heap type `name`, of entries of type `type`, along with its
+ * functions, `name_XXX()`. `on_move(type *ent, size_t idx)` is called
+ * whenever an entry is placed at index `idx` in the heap, e.g. to maintain
+ * back-references to the entry
+ */
+#define DHEAP_DEFINE(name, type, on_move)                                     \
+                                                                              \
+typedef struct name {                                                         \
+    int64_t *keys; /* Deadlines of entries, by index */                       \
+    type *ents;                                                               \
+    size_t size;                                                              \
+    size_t capacity;                                                          \
+    io_allocator const *alc;                                                  \
+    int fixed; /* Capacity may not change anymore */                          \
+} name;                                                                       \
+                                                                              \
+inline static void name##_init(name *hp, io_allocator const *alc) {           \
+    *hp = (name){NULL, NULL, 0, 0, alc, 0};                                   \
+}                                                                             \
+                                                                              \
+inline static void name##_delete(name *hp) {                                  \
+    iomem_free(hp->alc, hp->keys, hp->capacity * sizeof(*hp->keys));          \
+    iomem_free(hp->alc, hp->ents, hp->capacity * sizeof(*hp->ents));          \
+}                                                                             \
+                                                                              \
+/* Move both arrays to allocations of `capacity` entries, which must fit */   \
+/* all entries. Returns 0 on success, -1 if no memory could be allocated */   \
+inline static int name##_realloc(name *hp, size_t capacity) {                 \
+    /* Keys are moved only once entries were, so that both arrays keep */     \
+    /* the same capacity if an allocation fails */                            \
+    int64_t *keys = (int64_t *)iomem_alloc(hp->alc, capacity * sizeof(*keys), \
+                                           _Alignof(int64_t));                \
+    if (!keys)                                                                \
+        return -1;                                                            \
+                                                                              \
+    type *ents = (type *)iomem_realloc(hp->alc, hp->ents,                     \
+                                       hp->capacity * sizeof(*ents),          \
+                                       capacity * sizeof(*ents));             \
+    if (!ents) {                                                              \
+        iomem_free(hp->alc, keys, capacity * sizeof(*keys));                  \
+        return -1;                                                            \
+    }                                                                         \
+                                                                              \
+    if (hp->size)                                                             \
+        memcpy(keys, hp->keys, hp->size * sizeof(*keys));                     \
+    iomem_free(hp->alc, hp->keys, hp->capacity * sizeof(*keys));              \
+                                                                              \
+    hp->keys = keys;                                                          \
+    hp->ents = ents;                                                          \
+    hp->capacity = capacity;                                                  \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+/* Returns 0 on success, -1 if no memory could be allocated */                \
+inline static int name##_reserve(name *hp, size_t capacity) {                 \
+    if (capacity <= hp->capacity)                                             \
+        return 0;                                                             \
+                                                                              \
+    if (hp->fixed)                                                            \
+        return -1;                                                            \
+                                                                              \
+    return name##_realloc(hp, capacity);                                      \
+}                                                                             \
+                                                                              \
+/* Shrink to `capacity` entries, or to the size of the heap if greater. */    \
+/* Returns 0 on success, -1 if no memory could be allocated */                \
+inline static int name##_shrink(name *hp, size_t capacity) {                  \
+    if (capacity < hp->size)                                                  \
+        capacity = hp->size;                                                  \
+                                                                              \
+    if (hp->fixed || capacity >= hp->capacity)                                \
+        return 0;                                                             \
+                                                                              \
+    if (!capacity) {                                                          \
+        name##_delete(hp);                                                    \
+        *hp = (name){NULL, NULL, 0, 0, hp->alc, 0};                           \
+        return 0;                                                             \
+    }                                                                         \
+                                                                              \
+    return name##_realloc(hp, capacity);                                      \
+}                                                                             \
+                                                                              \
+/* Reserve `capacity` entries, and disable any further reallocation */        \
+inline static int name##_make_fixed(name *hp, size_t capacity) {              \
+    if (name##_reserve(hp, capacity) < 0)                                     \
+        return -1;                                                            \
+                                                                              \
+    hp->fixed = 1;                                                            \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+inline static void name##_place(name *hp, size_t idx, int64_t key,            \
+                                type const *ent) {                            \
+    hp->keys[idx] = key;                                                      \
+    hp->ents[idx] = *ent;                                                     \
+    on_move(&hp->ents[idx], idx);                                             \
+}                                                                             \
+                                                                              \
+inline static void name##_sift_up(name *hp, size_t idx) {                     \
+    int64_t key = hp->keys[idx];                                              \
+    type ent = hp->ents[idx];                                                 \
+                                                                              \
+    while (idx > 0) {                                                         \
+        size_t parent = (idx - 1) / DHEAP_ARITY;                              \
+                                                                              \
+        if (hp->keys[parent] <= key)                                          \
+            break;                                                            \
+                                                                              \
+        name##_place(hp, idx, hp->keys[parent], &hp->ents[parent]);           \
+        idx = parent;                                                         \
+    }                                                                         \
+                                                                              \
+    name##_place(hp, idx, key, &ent);                                         \
+}                                                                             \
+                                                                              \
+inline static void name##_sift_down(name *hp, size_t idx) {                   \
+    int64_t key = hp->keys[idx];                                              \
+    type ent = hp->ents[idx];                                                 \
+                                                                              \
+    while (1) {                                                               \
+        size_t first = DHEAP_ARITY * idx + 1;                                 \
+                                                                              \
+        if (first >= hp->size)                                                \
+            break;                                                            \
+                                                                              \
+        size_t end = hp->size - first > DHEAP_ARITY ?                         \
+                     first + DHEAP_ARITY : hp->size;                          \
+        size_t min = first;                                                   \
+                                                                              \
+        for (size_t child = first + 1; child < end; ++child)                  \
+            if (hp->keys[child] < hp->keys[min])                              \
+                min = child;                                                  \
+                                                                              \
+        if (hp->keys[min] >= key)                                             \
+            break;                                                            \
+                                                                              \
+        name##_place(hp, idx, hp->keys[min], &hp->ents[min]);                 \
+        idx = min;                                                            \
+    }                                                                         \
+                                                                              \
+    name##_place(hp, idx, key, &ent);                                         \
+}                                                                             \
+                                                                              \
+/* Make room for one more entry, growing geometrically */                    \
+/* Returns 0 on success, -1 if no memory could be allocated */                \
+inline static int name##_reserve_one(name *hp) {                              \
+    if (hp->size < hp->capacity)                                              \
+        return 0;                                                             \
+                                                                              \
+    return name##_reserve(hp, hp->capacity ? 2 * hp->capacity : 1);           \
+}                                                                             \
+                                                                              \
+/* Returns 0 on success, -1 if no memory could be allocated */                \
+inline static int name##_push(name *hp, int64_t key, type const *ent) {       \
+    if (name##_reserve_one(hp) < 0)                                           \
+        return -1;                                                            \
+                                                                              \
+    hp->keys[hp->size] = key;                                                 \
+    hp->ents[hp->size] = *ent;                                                \
+    name##_sift_up(hp, hp->size++);                                           \
+                                                                              \
+    return 0;                                                                 \
+}                                                                             \
+                                                                              \
+/* Move the entry at `idx` after its deadline was changed */                  \
+inline static void name##_update(name *hp, size_t idx) {                      \
+    if (idx > 0 && hp->keys[idx] < hp->keys[(idx - 1) / DHEAP_ARITY])         \
+        name##_sift_up(hp, idx);                                              \
+    else                                                                      \
+        name##_sift_down(hp, idx);                                            \
+}                                                                             \
+                                                                              \
+inline static void name##_remove(name *hp, size_t idx) {                      \
+    if (idx == --hp->size)                                                    \
+        return;                                                               \
+                                                                              \
+    hp->keys[idx] = hp->keys[hp->size];                                       \
+    hp->ents[idx] = hp->ents[hp->size];                                       \
+    name##_update(hp, idx);                                                   \
+}                                                                             \
+                                                                              \
+inline static void name##_pop(name *hp) {                                     \
+    name##_remove(hp, 0);                                                     \
+}                                                                             \
+                                                                              \
+/* Rearrange arbitrarily ordered entries into a heap */                       \
+inline static void name##_make(name *hp) {                                    \
+    if (hp->size < 2)                                                         \
+        return;                                                               \
+                                                                              \
+    /* Sift down all non-leaf nodes, bottom-up */                             \
+    for (size_t idx = (hp->size - 2) / DHEAP_ARITY + 1; idx-- > 0;)           \
+        name##_sift_down(hp, idx);                                            \
+}
+
+#endif // IO_DHEAP_H_
@@ -1,5 +1,7 @@
 #include "dynarray.h"
 
+#include "iomem.h"
+
 #define DYNARR_MIN_CAPACITY 1
 
 inline static size_t mx(size_t a, size_t b) {
@@ -8,10 +10,13 @@ inline static size_t mx(size_t a, size_t b) {
 
 void *dynarr_emplace_back(dynarray *const dar) {
     if (dar->nelems == dar->capacity) {
-        size_t new_capacity = mx(2 * dar->capacity, DYNARR_MIN_CAPACITY);
-        size_t new_size = dar->obj_size * new_capacity;
+        if (dar->fixed)
+            return NULL;
 
-        void *new_data = realloc(dar->data, new_size);
+        size_t new_capacity = mx(2 * dar->capacity, DYNARR_MIN_CAPACITY);
+        void *new_data = iomem_realloc(dar->alc, dar->data,
+                                       dar->obj_size * dar->capacity,
+                                       dar->obj_size * new_capacity);
 
         if (!new_data)
             return NULL;
@@ -26,11 +31,68 @@ void *dynarr_emplace_back(dynarray *const dar) {
     return retval;
 }
 
-void dynarr_init(dynarray *const dar, size_t obj_size) {
+int dynarr_reserve(dynarray *const dar, size_t capacity) {
+    if (capacity <= dar->capacity)
+        return 0;
+
+    if (dar->fixed)
+        return -1;
+
+    void *new_data = iomem_realloc(dar->alc, dar->data,
+                                   dar->obj_size * dar->capacity,
+                                   dar->obj_size * capacity);
+
+    if (!new_data)
+        return -1;
+
+    dar->data = new_data;
+    dar->capacity = capacity;
+
+    return 0;
+}
+
+int dynarr_make_fixed(dynarray *const dar, size_t capacity) {
+    if (dynarr_reserve(dar, capacity) < 0)
+        return -1;
+
+    dar->fixed = 1;
+    return 0;
+}
+
+int dynarr_shrink(dynarray *const dar, size_t capacity) {
+    if (capacity < dar->nelems)
+        capacity = dar->nelems;
+
+    if (dar->fixed || capacity >= dar->capacity)
+        return 0;
+
+    if (!capacity) {
+        dynarr_delete(dar);
+        dar->data = NULL;
+        dar->capacity = 0;
+        return 0;
+    }
+
+    void *new_data = iomem_realloc(dar->alc, dar->data,
+                                   dar->obj_size * dar->capacity,
+                                   dar->obj_size * capacity);
+
+    if (!new_data)
+        return -1;
+
+    dar->data = new_data;
+    dar->capacity = capacity;
+
+    return 0;
+}
+
+void dynarr_init(dynarray *const dar, size_t obj_size,
+                 io_allocator const *alc) {
     *dar = (dynarray){
-        .data = NULL, .capacity = 0, .nelems = 0, .obj_size = obj_size};
+        .data = NULL, .capacity = 0, .nelems = 0, .obj_size = obj_size,
+        .alc = alc, .fixed = 0};
 }
 
 void dynarr_delete(dynarray *const dar) {
-    free(dar->data);
+    iomem_free(dar->alc, dar->data, dar->obj_size * dar->capacity);
 }
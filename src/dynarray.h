@@ -4,19 +4,48 @@
 #include <stddef.h>
 #include <stdlib.h>
 
+#include "iotypes.h"
+
 typedef struct dynarray {
     void *data;
     size_t nelems;
     size_t capacity;
     size_t obj_size;
+    io_allocator const *alc;
+    int fixed; // Capacity may not change anymore
 } dynarray;
 
-void dynarr_init(dynarray *const dar, size_t obj_size);
+void dynarr_init(dynarray *const dar, size_t obj_size,
+                 io_allocator const *alc);
 
 void dynarr_delete(dynarray *const dar);
 
 void *dynarr_emplace_back(dynarray *const dar);
 
+/**
+ * @brief Grow the capacity of the array to at least `capacity` elements, so
+ * that no reallocation is needed until then
+ * 
+ * @return 0 on success, -1 if no memory could be allocated
+ */
+int dynarr_reserve(dynarray *const dar, size_t capacity);
+
+/**
+ * @brief Reserve capacity for `capacity` elements, and disable any further
+ * reallocation. Once full, the array can not grow anymore
+ * 
+ * @return 0 on success, -1 if no memory could be allocated
+ */
+int dynarr_make_fixed(dynarray *const dar, size_t capacity);
+
+/**
+ * @brief Shrink the capacity of the array to `capacity` elements, or to its
+ * size if greater. Arrays with fixed capacity are left untouched
+ * 
+ * @return 0 on success, -1 if no memory could be allocated
+ */
+int dynarr_shrink(dynarray *const dar, size_t capacity);
+
 inline static void dynarr_pop_back(dynarray *const dar) {
     --dar->nelems;
 }
@@ -2,30 +2,7 @@
 #define IO_HEAPUTILS_H_ 1
 
 #include <time.h>
-
-#include "dynarray.h"
-
-void heap_sift_up_idx(dynarray *heap, size_t idx,
-                      int (*lt)(const void *, const void *),
-                      void (*swap)(void *, void *));
-
-void heap_sift_down_idx(dynarray *heap, size_t idx,
-                        int (*lt)(const void *, const void *),
-                        void (*swap)(void *, void *));
-
-inline static void heap_sift_up(dynarray *heap, void *elem,
-                                int (*lt)(const void *, const void *),
-                                void (*swap)(void *, void *)) {
-    size_t idx = (size_t)((char *)elem - (char *)heap->data) / heap->obj_size;
-    heap_sift_up_idx(heap, idx, lt, swap);
-}
-
-inline static void heap_sift_down(dynarray *heap, void *elem,
-                                  int (*lt)(const void *, const void *),
-                                  void (*swap)(void *, void *)) {
-    size_t idx = (size_t)((char *)elem - (char *)heap->data) / heap->obj_size;
-    heap_sift_down_idx(heap, idx, lt, swap);
-}
+#include <stdint.h>
 
 inline static int64_t current_time() {
     struct timespec curr_time;
@@ -33,4 +10,26 @@ inline static int64_t current_time() {
     return curr_time.tv_sec * 1000L + curr_time.tv_nsec / 1000000L;
 }
 
+inline static int64_t current_time_us() {
+    struct timespec curr_time;
+    clock_gettime(CLOCK_MONOTONIC, &curr_time);
+    return curr_time.tv_sec * 1000000L + curr_time.tv_nsec / 1000L;
+}
+
+/**
+ * @brief Round a deadline up to the next multiple of `slack`, so that timers
+ * with close deadlines and the same slack share a single deadline
+ * 
+ * @param deadline deadline to round
+ * @param slack maximum delay that may be added to the deadline (0 for none)
+ * @return Rounded deadline
+ */
+inline static int64_t apply_slack(int64_t deadline, int slack) {
+    if (slack <= 0)
+        return deadline;
+
+    int64_t rem = deadline % slack;
+    return rem ? deadline - rem + slack : deadline;
+}
+
 #endif // IO_HEAPUTILS_H_
@@ -1,6 +1,7 @@
 #include "io_semaphore.h"
 
-#include <stdlib.h>
+#include "iosvc_def.h"
+#include "iomem.h"
 
 typedef struct pending_handler_node {
     struct pending_handler_node *next;
@@ -14,7 +15,8 @@ struct _io_sem_t {
 };
 
 io_semaphore *iosem_create(int init_val, io_service *iosvc) {
-    io_semaphore *iosem = (io_semaphore *)malloc(sizeof(*iosem));
+    io_semaphore *iosem = (io_semaphore *)iomem_alloc(
+        &iosvc->allocator, sizeof(*iosem), _Alignof(io_semaphore));
 
     if (iosem)
         *iosem = (io_semaphore) {
@@ -32,10 +34,10 @@ void iosem_delete(io_semaphore *iosem) {
         iosem->handler_list = curr->next;
 
         (void)iosvc_post(iosem->iosvc, curr->hnd);
-        free(curr);
+        iomem_free(&iosem->iosvc->allocator, curr, sizeof(*curr));
     }
 
-    free(iosem);
+    iomem_free(&iosem->iosvc->allocator, iosem, sizeof(*iosem));
 }
 
 io_errcode iosem_wait(io_semaphore *iosem, io_handler hnd) {
@@ -44,8 +46,9 @@ io_errcode iosem_wait(io_semaphore *iosem, io_handler hnd) {
         return iosvc_post(iosem->iosvc, hnd);
     }
 
-    pending_handler_node *curr_hnd =
-        (pending_handler_node *)malloc(sizeof(*curr_hnd));
+    pending_handler_node *curr_hnd = (pending_handler_node *)iomem_alloc(
+        &iosem->iosvc->allocator, sizeof(*curr_hnd),
+        _Alignof(pending_handler_node));
     
     if (!curr_hnd)
         return EIO_NOMEM;
@@ -67,7 +70,7 @@ io_errcode iosem_signal(io_semaphore *iosem) {
     iosem->handler_list = to_sched->next;
 
     io_errcode errc = iosvc_post(iosem->iosvc, to_sched->hnd);
-    free(to_sched);
+    iomem_free(&iosem->iosvc->allocator, to_sched, sizeof(*to_sched));
 
     return errc;
 }
@@ -3,12 +3,36 @@
 
 #include <poll.h>
 #include <errno.h>
+#include <limits.h>
 #include <time.h>
 
 #include "async_heap_entry.h"
 #include "delay_heap_entry.h"
 #include "heaputils.h"
 #include "iosvc_dequeue.h"
+#include "iosvc_cork.h"
+#include "iosvc_nodepool.h"
+#include "iosvc_capacity.h"
+#include "iosvc_opslot.h"
+#include "iosvc_delayed.h"
+#include "iosvc_tmoclass.h"
+#include "iosvc_fdopt.h"
+#include "iosvc_busypoll.h"
+#include "iosvc_backend.h"
+#include "iosvc_hooks.h"
+
+#define STOP_BATCH 128 // Operations released before their handlers are called
+
+// Queues that timers are kept in, besides timeout classes, which are
+// identified by their (nonnegative) class ID
+enum {
+    TQ_DELAYS = -2,
+    TQ_EVENTS = -1
+};
+
+int64_t iosvc_now(void) {
+    return current_time();
+}
 
 io_errcode iosvc_stop(io_service *iosvc) {
     switch (iosvc->status) {
@@ -24,6 +48,27 @@ io_errcode iosvc_stop(io_service *iosvc) {
     }
 }
 
+io_errcode iosvc_drain(io_service *iosvc, int64_t deadline) {
+    if (deadline < 0)
+        return EIO_INVARG;
+
+    switch (iosvc->status) {
+    case RUNNING:
+        if (iosvc->draining)
+            return EIO_INPROGRESS;
+
+        iosvc->draining = DRAIN_REQUESTED;
+        iosvc->drain_deadline = deadline;
+        return EIO_OK;
+
+    case STOPPING:
+        return EIO_INPROGRESS;
+
+    default:
+        return EIO_NOENTRY;
+    }
+}
+
 io_errcode iosvc_reset(io_service *iosvc) {
     switch (iosvc->status) {
     case RUNNING:
@@ -36,92 +81,280 @@ io_errcode iosvc_reset(io_service *iosvc) {
     }
 }
 
-static void run_sync_handlers(io_service *iosvc) {
-    cbuffer *handlers = &iosvc->sync_handlers;
+void iosvc_set_budget(io_service *iosvc, size_t handlers, size_t events,
+                      size_t timers) {
+    iosvc->handler_budget = handlers;
+    iosvc->event_budget = events;
+    iosvc->timer_budget = timers;
+}
+
+/**
+ * @brief Get the highest priority queue of posted handlers that is not empty
+ * 
+ * @param iosvc service to query
+ * @return The queue, or `NULL` if no handlers are posted
+ */
+static cbuffer *next_sync_handlers(io_service *iosvc) {
+    for (int i = 0; i < IO_PRIO_COUNT; ++i)
+        if (!cbuf_empty(&iosvc->sync_handlers[i]))
+            return &iosvc->sync_handlers[i];
+
+    return NULL;
+}
+
+/**
+ * @brief Run posted handlers, within the budget
+ * 
+ * @param iosvc service whose handlers to run
+ * @return Number of handlers run
+ */
+static size_t run_sync_handlers(io_service *iosvc) {
+    cbuffer *handlers;
+    size_t budget = iosvc->handler_budget;
+    size_t ran = 0;
+
+    // Handlers posted by the ones run here count against the budget too.
+    // The queue is picked again for each handler, so that handlers of
+    // higher priority posted meanwhile go first
+    for (; (handlers = next_sync_handlers(iosvc)); ++ran) {
+        if (budget && ran == budget)
+            break;
 
-    while (!cbuf_empty(handlers)) {
         io_handler *curr_hnd = cbuf_front(handlers);
-        curr_hnd->callback(curr_hnd->ctx);
+        io_handler hnd = *curr_hnd;
+
         cbuf_pop(handlers);
+        hnd.callback(hnd.ctx);
     }
+
+    return ran;
 }
 
 /**
- * @brief Stop an async event's handler. Sets status to `EIO_STOPPED` if 
- * provided, sets remaining time (if this is a timeout event)
- * and calls the handler's callback
+ * @brief Call a batch of handlers of stopped operations
  * 
- * @param evt event to be stopped
+ * @param hnds handlers to call
+ * @param count number of handlers
+ */
+static void call_batch(io_handler const *hnds, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        hnds[i].callback(hnds[i].ctx);
+}
+
+/**
+ * @brief Stop an async event. Sets status to `EIO_STOPPED` if provided, and
+ * sets remaining time (if this is a timeout event). The handler is left for
+ * the caller to call
+ * 
+ * @param iosvc service the event belongs to
+ * @param node node holding the event
+ * @param wait_type wait type of the event
  * @param now current time
- * @param hp deadlines heap
+ * @return The handler of the event
  */
-static void stop_handler(event_data *evt, int64_t now, async_heap_entry *hp) {
+static io_handler stop_event(io_service *iosvc, rb_node *node,
+                             io_wait_type wait_type, int64_t now) {
+    async_heap *hp = &iosvc->timed_events_heap;
+    event_data *evt = get_evt_data(node, wait_type);
+    uint32_t op_slot = node->cold ? node->cold->op_slot[wait_type] :
+                                    OPSLOT_NONE;
+    uint32_t tmo_idx = node->cold ? node->cold->tmo_idx[wait_type] :
+                                    TMO_NONE;
+
+    if (op_slot != OPSLOT_NONE)
+        opslot_free(iosvc, op_slot);
+
     if (evt->status)
         *evt->status = EIO_STOPPED;
 
     if (evt->ddl_heap_idx >= 0) {
-        async_heap_entry *heap_ent = &hp[evt->ddl_heap_idx];
+        async_heap_entry *heap_ent = &hp->ents[evt->ddl_heap_idx];
 
-        int64_t remaining = heap_ent->deadline - now;
-        *heap_ent->remaining = (remaining > 0L ? (int)remaining : 0L);
+        if (heap_ent->remaining) {
+            int64_t remaining = hp->keys[evt->ddl_heap_idx] - now;
+            *heap_ent->remaining = (remaining > 0L ? (int)remaining : 0);
+        }
     }
 
-    evt->handler.callback(evt->handler.ctx);
+    if (tmo_idx != TMO_NONE) {
+        tmo_entry *ent = tmo_at(iosvc, tmo_idx);
+
+        if (ent->remaining) {
+            int64_t remaining = ent->deadline - now;
+            *ent->remaining = (remaining > 0L ? (int)remaining : 0);
+        }
+    }
+
+    return evt->handler;
 }
 
 /**
- * @brief Stop all asynchronous operations contained in provided node.
- * Recursively call for child nodes
+ * @brief Stop all asynchronous operations, and release all nodes. Nodes are
+ * walked through `pollfd_nodes` rather than the tree, in batches: the events
+ * of a batch are stopped and their nodes released, then their handlers are
+ * called
+ * 
+ * The set of nodes is frozen meanwhile, as events can neither be scheduled
+ * nor cancelled while the service is stopping
  * 
- * @param node node containing handlers and associated data
+ * @param iosvc service to stop the operations of
  * @param now current time
- * @param hp deadline heap
  */
-static void stop_async_ops(rb_node *node, int64_t now, async_heap_entry *hp) {
-    if (!node)
-        return;
+static void stop_async_ops(io_service *iosvc, int64_t now) {
+    static io_wait_type const wts[] = {
+        WAIT_READ, WAIT_WRITE, WAIT_EXCEPTION
+    };
 
-    if (node->main_event.handler.callback)
-        stop_handler(&node->main_event, now, hp);
+    io_handler batch[STOP_BATCH * 3];
+    size_t count = dynarr_size(&iosvc->pollfd_nodes);
 
-    if (node->aux_event && node->aux_event->handler.callback)
-        stop_handler(node->aux_event, now, hp);
+    for (size_t first = 0; first < count; first += STOP_BATCH) {
+        size_t last = (count - first > STOP_BATCH) ? first + STOP_BATCH :
+                                                     count;
+        size_t nhnd = 0;
 
-    if (node->ex_event && node->ex_event->handler.callback)
-        stop_handler(node->ex_event, now, hp);
+        // Handlers may trim the service, so the array is not cached
+        for (size_t i = first; i < last; ++i) {
+            rb_node *node = *(rb_node **)dynarr_at(&iosvc->pollfd_nodes, i);
 
-    free(node->aux_event);
-    free(node->ex_event);
+            for (size_t j = 0; j < 3; ++j)
+                if (is_pending(node, wts[j]))
+                    batch[nhnd++] = stop_event(iosvc, node, wts[j], now);
 
-    stop_async_ops(node->left, now, hp);
-    stop_async_ops(node->right, now, hp);
+            node_release(iosvc, node);
+        }
 
-    free(node);
+        call_batch(batch, nhnd);
+    }
 }
 
 /**
- * @brief Stop the io_service
+ * @brief Stop all delayed handlers, in batches: entries of a batch are
+ * removed from the heap, then their handlers are called
  * 
- * @param iosvc service to stop
+ * @param iosvc service to stop the delayed handlers of
  */
-static void iosvc_prep_stop(io_service *iosvc) {
-    // Run timed non-event handlers
-    delay_heap_entry *curr_ent = 
-        (delay_heap_entry *)dynarr_front(&iosvc->timed_handlers_heap);
+static void stop_delayed(io_service *iosvc) {
+    delay_heap *hp = &iosvc->timed_handlers_heap;
+    io_handler batch[STOP_BATCH];
+
+    // No new handlers can be delayed while the service is stopping, but
+    // handlers may trim the service, moving the heap. Entries are taken from
+    // the back, which needs no reordering of the heap
+    while (hp->size) {
+        size_t nhnd = 0;
+
+        while (hp->size && nhnd < STOP_BATCH) {
+            delay_heap_entry ent = hp->ents[--hp->size];
+
+            if (ent.op_slot != OPSLOT_NONE) {
+                int cancelled = opslot_at(iosvc, ent.op_slot)->cancelled;
+                opslot_free(iosvc, ent.op_slot);
+
+                if (cancelled)
+                    continue;
+            }
+
+            if (ent.status)
+                *ent.status = EIO_STOPPED;
+
+            batch[nhnd++] = ent.handler;
+        }
+
+        call_batch(batch, nhnd);
+    }
+
+    iosvc->cancelled_delays = 0;
+}
+
+/**
+ * @brief Stop the delayed handlers of all timeout classes, in batches.
+ * Entries of events are left to `stop_async_ops()`, and all entries are
+ * released by `tmo_clear()` afterwards, so lists stay intact meanwhile
+ * 
+ * @param iosvc service to stop the handlers of
+ */
+static void stop_class_delays(io_service *iosvc) {
+    io_handler batch[STOP_BATCH];
+    size_t nhnd = 0;
+
+    for (size_t i = 0; i < dynarr_size(&iosvc->tmo_classes); ++i) {
+        uint32_t idx = tmo_class_at(iosvc, (uint32_t)i)->head;
+
+        while (idx != TMO_NONE) {
+            tmo_entry *ent = tmo_at(iosvc, idx);
+            idx = ent->next;
+
+            if (ent->is_event)
+                continue;
 
-    for (size_t i = 0; i < iosvc->timed_handlers_heap.nelems; ++i) {
-        if (curr_ent->status)
-            *curr_ent->status = EIO_STOPPED;
+            if (ent->op_slot != OPSLOT_NONE)
+                opslot_free(iosvc, ent->op_slot);
 
-        io_handler *handler = &curr_ent->handler;
-        handler->callback(handler->ctx);
+            if (ent->status)
+                *ent->status = EIO_STOPPED;
 
-        // Pointer is never invalidated as new callbacks cant be registered
-        // if service is stopped
-        ++curr_ent;
+            batch[nhnd++] = ent->hnd;
+
+            if (nhnd == STOP_BATCH) {
+                call_batch(batch, nhnd);
+                nhnd = 0;
+            }
+        }
     }
 
-    dynarr_clear(&iosvc->timed_handlers_heap);
+    call_batch(batch, nhnd);
+}
+
+/**
+ * @brief Stop the pending events of all listeners, as a drain starts. The
+ * settings are walked by FD rather than by index, since handlers may change
+ * them
+ * 
+ * @param iosvc service to drain
+ * @param now current time
+ */
+static void drain_listeners(io_service *iosvc, int64_t now) {
+    static io_wait_type const wts[] = {
+        WAIT_READ, WAIT_WRITE, WAIT_EXCEPTION
+    };
+
+    fd_opt *opt;
+    int64_t next_fd = INT_MIN;
+
+    while (next_fd <= INT_MAX &&
+           (opt = fdopt_lower_bound(iosvc, (int)next_fd))) {
+        int fd = opt->fd;
+        next_fd = (int64_t)fd + 1;
+
+        if (!(opt->flags & FDOPT_LISTENER))
+            continue;
+
+        // The node is looked up again for each event, as handlers may
+        // release the FD
+        for (size_t j = 0; j < 3; ++j) {
+            rb_node *parent;
+            rb_node *node = *rb_probe(&iosvc->async_handlers, &parent, fd);
+
+            if (!node || !is_pending(node, wts[j]))
+                continue;
+
+            io_handler hnd = iosvc_dequeue(iosvc, node, wts[j], now,
+                                           EIO_STOPPED);
+            hnd.callback(hnd.ctx);
+        }
+    }
+}
+
+/**
+ * @brief Stop the io_service
+ * 
+ * @param iosvc service to stop
+ */
+static void iosvc_prep_stop(io_service *iosvc) {
+    // Run the handlers of timers that are not events, then those of events
+    stop_delayed(iosvc);
+    stop_class_delays(iosvc);
 
     // Stop all asynchronous operations
     struct timespec curr_time;
@@ -129,63 +362,100 @@ static void iosvc_prep_stop(io_service *iosvc) {
 
     int64_t now = curr_time.tv_nsec / 1000000L + curr_time.tv_sec * 1000L;
 
-    stop_async_ops(iosvc->async_handlers, now,
-                   (async_heap_entry *)dynarr_front(&iosvc->timed_events_heap));
-    dynarr_clear(&iosvc->timed_events_heap);
+    stop_async_ops(iosvc, now);
+    iosvc->timed_events_heap.size = 0;
+    backend_clear(iosvc);
     dynarr_clear(&iosvc->pollfds);
+    dynarr_clear(&iosvc->pollfd_nodes);
     iosvc->async_handlers = NULL;
+    iosvc->idle_nodes = NULL;
+    iosvc->draining = DRAIN_NONE;
+
+    tmo_clear(iosvc);
 }
 
 /**
  * @brief Fetch next deadline
  * 
  * @param iosvc service to fetch next deadline from
- * @param is_event out parameter specifying if the next deadline is from
- * an async event or from a timed, non-event handler
+ * @param queue out parameter specifying the queue of the timer with the next
+ * deadline: `TQ_DELAYS` for timed, non-event handlers, `TQ_EVENTS` for async
+ * events, or the ID of a timeout class
  * @return next deadline, in milliseconds 
  */
-static int64_t next_deadline(io_service *iosvc, int *is_event) {
+static int64_t next_deadline(io_service *iosvc, int *queue) {
     int64_t deadline = -1;
 
-    if (!dynarr_empty(&iosvc->timed_handlers_heap)) {
-        delay_heap_entry *top =
-            (delay_heap_entry *)dynarr_front(&iosvc->timed_handlers_heap);
+    if (iosvc->timed_handlers_heap.size) {
+        deadline = iosvc->timed_handlers_heap.keys[0];
+        *queue = TQ_DELAYS;
+    }
 
-        deadline = top->deadline;
-        *is_event = 0;
+    if (iosvc->timed_events_heap.size) {
+        int64_t top = iosvc->timed_events_heap.keys[0];
+
+        if (deadline == -1 || top < deadline) {
+            deadline = top;
+            *queue = TQ_EVENTS;
+        }
     }
 
-    if (!dynarr_empty(&iosvc->timed_events_heap)) {
-        async_heap_entry *top =
-            (async_heap_entry *)dynarr_front(&iosvc->timed_events_heap);
-        
-        if (deadline == -1 || top->deadline < deadline) {
-            deadline = top->deadline;
-            *is_event = 1;
+    // Timers of a class expire in FIFO order, so only heads are checked
+    if (iosvc->armed_tmos) {
+        tmo_class *classes = (tmo_class *)dynarr_front(&iosvc->tmo_classes);
+
+        for (size_t i = 0; i < dynarr_size(&iosvc->tmo_classes); ++i) {
+            if (classes[i].head == TMO_NONE)
+                continue;
+
+            tmo_entry *head = tmo_at(iosvc, classes[i].head);
+
+            if (deadline == -1 || head->deadline < deadline) {
+                deadline = head->deadline;
+                *queue = (int)i;
+            }
         }
     }
 
     return deadline;
 }
 
-int is_top_event_ready(io_service *iosvc) {
-    if (dynarr_empty(&iosvc->timed_events_heap))
+int iosvc_next_timeout(io_service *iosvc) {
+    // Work that is not waiting for anything must be run right away
+    if (iosvc->status == STOPPING || next_sync_handlers(iosvc) ||
+        !dynarr_empty(&iosvc->corked_fds))
         return 0;
 
-    async_heap_entry *top_event =
-        (async_heap_entry *)dynarr_front(&iosvc->timed_events_heap);
-    
-    size_t poll_idx = top_event->io_op_data->pollfd_idx;
+    if (iosvc->draining == DRAIN_REQUESTED)
+        return 0;
 
-    static short const evt_masks[] = {
-        [WAIT_READ] = (POLLIN | POLLHUP | POLLRDNORM | POLLRDBAND | POLLERR),
-        [WAIT_WRITE] = (POLLOUT | POLLWRNORM | POLLWRBAND | POLLERR),
-        [WAIT_EXCEPTION] = POLLPRI
-    };
+    int queue;
+    int64_t deadline = next_deadline(iosvc, &queue);
 
-    struct pollfd *pollvec = (struct pollfd *)iosvc->pollfds.data;
+    // The service is stopped at the drain deadline, even if idle
+    if (iosvc->draining &&
+        (deadline == -1 || iosvc->drain_deadline < deadline))
+        deadline = iosvc->drain_deadline;
 
-    return (pollvec[poll_idx].revents & evt_masks[top_event->event_type]) != 0;
+    if (deadline == -1)
+        return -1;
+
+    int64_t left = deadline - current_time();
+    return left <= 0 ? 0 : left > INT_MAX ? INT_MAX : (int)left;
+}
+
+/**
+ * @brief Dequeue an event with status `EIO_TIMEOUT` and call its handler
+ * 
+ * @param iosvc service the event is scheduled on
+ * @param node node holding the event
+ * @param wait_type wait type of the event
+ * @param now current time
+ */
+static void timeout_event(io_service *iosvc, rb_node *node,
+                          io_wait_type wait_type, int64_t now) {
+    io_handler hnd = iosvc_dequeue(iosvc, node, wait_type, now, EIO_TIMEOUT);
+    hnd.callback(hnd.ctx);
 }
 
 /**
@@ -193,60 +463,153 @@ int is_top_event_ready(io_service *iosvc) {
  * handler
  * 
  * @param iosvc service to remove the event from
- * @param is_event type of operation (1 if fd-based event, 0 if delayed handler)
+ * @param queue queue of the timer, as provided by `next_deadline()`
  * @param now current time
  */
-void timeout_first(io_service *iosvc, int is_event, int64_t now) {
-    if (is_event) {
-        async_heap_entry *top_event =
-            (async_heap_entry *)dynarr_front(&iosvc->timed_events_heap);
-        
-        rb_node *node = top_event->io_op_data;
-
-        int *remaining_ptr = top_event->remaining;
-        io_handler hnd = iosvc_dequeue(iosvc, node, top_event->event_type,
-                                       now, EIO_TIMEOUT);
-        *remaining_ptr = 0;
-        hnd.callback(hnd.ctx);
+void timeout_first(io_service *iosvc, int queue, int64_t now) {
+    if (queue == TQ_EVENTS) {
+        async_heap_entry *top_event = &iosvc->timed_events_heap.ents[0];
+
+        // The deadline has passed, so the remaining time is set to 0
+        timeout_event(iosvc, top_event->io_op_data, top_event->event_type,
+                      now);
+    } else if (queue >= 0) {
+        uint32_t head_idx = tmo_class_at(iosvc, (uint32_t)queue)->head;
+        tmo_entry head = *tmo_at(iosvc, head_idx);
+
+        if (head.is_event) {
+            timeout_event(iosvc, head.node, head.wait_type, now);
+            return;
+        }
 
-        rb_node *parent;
-        rb_place ref_to_this = rb_ref_to_this(node, &iosvc->async_handlers,
-                                              &parent);
+        tmo_remove(iosvc, head_idx);
 
-        struct pollfd *pollvec = (struct pollfd *)dynarr_front(&iosvc->pollfds);
+        if (head.op_slot != OPSLOT_NONE)
+            opslot_free(iosvc, head.op_slot);
 
-        if (pollvec[node->pollfd_idx].events == 0)
-            ioevt_cleanup_evt(iosvc, ref_to_this, parent);
+        if (head.status)
+            *head.status = EIO_OK;
+        head.hnd.callback(head.hnd.ctx);
     } else {
-        delay_heap_entry *top_callback =
-            (delay_heap_entry *)dynarr_front(&iosvc->timed_handlers_heap);
-        
-        if (top_callback->status)
-            *top_callback->status = EIO_OK;
-        top_callback->handler.callback(top_callback->handler.ctx);
-
-        // Handler might have resized vector, get beginning again
-        top_callback =
-            (delay_heap_entry *)dynarr_front(&iosvc->timed_handlers_heap);
-        *top_callback = top_callback[iosvc->timed_handlers_heap.nelems - 1];
-        dynarr_pop_back(&iosvc->timed_handlers_heap);
-
-        if (!dynarr_empty(&iosvc->timed_handlers_heap))
-            heap_sift_down_idx(&iosvc->timed_handlers_heap, 0,
-                               delay_hp_ent_lt, delay_hp_ent_swp);
+        delay_heap *heap = &iosvc->timed_handlers_heap;
+        delay_heap_entry *top = &heap->ents[0];
+        delay_heap_entry top_callback = *top;
+
+        if (top_callback.period) {
+            // Compute the next deadline from the previous (nominal) one, so
+            // that the timer does not drift. Ticks missed because of loop lag are
+            // skipped rather than run in a burst
+            top->due += top_callback.period;
+
+            if (top->due <= now)
+                top->due += ((now - top->due) / top_callback.period + 1) *
+                            top_callback.period;
+
+            heap->keys[0] = apply_slack(top->due, top_callback.slack);
+            delay_heap_sift_down(heap, 0);
+            delayed_discard_cancelled(iosvc);
+
+            if (top_callback.status)
+                *top_callback.status = EIO_OK;
+            top_callback.handler.callback(top_callback.handler.ctx);
+            return;
+        }
+
+        // Cancelled handlers are discarded as soon as they reach the top,
+        // so this one is live
+        delayed_pop(iosvc);
+        delayed_discard_cancelled(iosvc);
+
+        if (top_callback.op_slot != OPSLOT_NONE)
+            opslot_free(iosvc, top_callback.op_slot);
+
+        if (top_callback.status)
+            *top_callback.status = EIO_OK;
+        top_callback.handler.callback(top_callback.handler.ctx);
     }
 }
 
-void dispatch_ready_events(io_service *iosvc, int64_t now) {
+/**
+ * @brief Time out all timers that are due. Timers sharing a deadline
+ * (e.g. coalesced via timer slack) thus cost a single wakeup. Called after
+ * dispatch, so events that were ready in time are already completed, and
+ * events left unserved by the budget time out
+ * 
+ * @param iosvc service whose timers to expire
+ * @param now current time
+ * @return Number of timers expired
+ */
+static size_t expire_timers(io_service *iosvc, int64_t now) {
+    int queue;
+    int64_t deadline;
+    size_t expired = 0;
+
+    // Timers left over by the budget are still due at the next poll, which
+    // thus does not block
+    while ((deadline = next_deadline(iosvc, &queue)) != -1 &&
+           deadline <= now) {
+        if (iosvc->timer_budget && expired == iosvc->timer_budget)
+            break;
+
+        timeout_first(iosvc, queue, now);
+        ++expired;
+    }
+
+    return expired;
+}
+
+/**
+ * @brief Serve ready file descriptors, in a rotating order
+ * 
+ * @param iosvc service to dispatch events of
+ * @param now current time
+ * @param prio only serve file descriptors of this priority, or any if
+ * negative
+ * @param limit number of file descriptors served in this iteration to stop
+ * at, or 0 for no limit
+ * @param dispatched in-out parameter; number of file descriptors served so
+ * far in this iteration, checked against `limit`
+ * @return Number of pollfd positions visited
+ */
+static size_t dispatch_pass(io_service *iosvc, int64_t now, int prio,
+                            size_t limit, size_t *dispatched) {
 #define PVEC ((struct pollfd *)iosvc->pollfds.data)
 
-    for (size_t i = 0; i < dynarr_size(&iosvc->pollfds);) {;
-        rb_node *parent;
-        rb_place place = rb_probe(&iosvc->async_handlers, &parent, 
-                                    PVEC[i].fd);
+    size_t npolled = dynarr_size(&iosvc->pollfds);
+    size_t k;
+
+    if (npolled == 0)
+        return 0;
+
+    // Rotate the starting index, so that no FD is always served first
+    size_t start = iosvc->dispatch_start % npolled;
+
+    // Registrations left with no events linger until the end of the
+    // iteration, so pollfds keep their positions and nodes stay valid while
+    // handlers run. Pollfds added by handlers are appended past `npolled`
+    for (k = 0; k < npolled; ++k) {
+        if (limit && *dispatched >= limit)
+            break;
+
+        size_t i = (start + k) % npolled;
+
+        if (!PVEC[i].revents ||
+            (prio >= 0 && (int)fdopt_priority(iosvc, PVEC[i].fd) != prio))
+            continue;
+
+        short events = PVEC[i].events;
+        short revents = PVEC[i].revents;
+        PVEC[i].revents = 0;
+
+        // Found by index, without walking the tree
+        rb_node *node = ((rb_node **)iosvc->pollfd_nodes.data)[i];
+
+        // Only FDs whose handlers run count against the budget, e.g. not a
+        // hang-up reported for an FD that only waits for exceptions
+        int served = 0;
 
         // Check if FD was invalid
-        if (PVEC[i].revents & POLLNVAL) {
+        if (revents & POLLNVAL) {
             static const short pfd_flags[] = {
                 POLLIN, POLLOUT, POLLPRI
             };
@@ -257,47 +620,193 @@ void dispatch_ready_events(io_service *iosvc, int64_t now) {
             // Call all handlers with EIO_INVARG
             for (size_t ev_idx = 0; ev_idx < 3; ++ev_idx)
                 if (PVEC[i].events & pfd_flags[ev_idx]) {
-                    io_handler hnd = iosvc_dequeue(iosvc, *place, wts[ev_idx],
+                    io_handler hnd = iosvc_dequeue(iosvc, node, wts[ev_idx],
                                                    now, EIO_INVARG);
                     hnd.callback(hnd.ctx);
+                    served = 1;
                 }
-            
-            PVEC[i].revents = 0;
-            if (PVEC[i].events == 0)
-                ioevt_cleanup_evt(iosvc, place, parent);
+
+            *dispatched += (size_t)served;
             continue;
         }
 
-        int has_priority = PVEC[i].revents & POLLPRI;
-        int has_error = PVEC[i].revents & POLLERR;
-        int has_read = PVEC[i].revents & (POLLIN | POLLHUP | POLLRDBAND | POLLRDNORM);
-        int has_write = PVEC[i].revents & (POLLOUT | POLLWRNORM | POLLWRBAND);
-
-        if (has_priority) {
-            io_handler hnd = iosvc_dequeue(iosvc, *place, WAIT_EXCEPTION, now, EIO_OK);
+        // Errors and hang-ups are reported regardless of the requested
+        // events, so only dispatch them to handlers that are pending.
+        // If both read and write are pending, errors go to read by convention
+        int has_priority = (events & POLLPRI) && (revents & POLLPRI);
+        int has_read = (events & POLLIN) &&
+            (revents & (POLLIN | POLLHUP | POLLRDBAND | POLLRDNORM | POLLERR));
+        int has_write = (events & POLLOUT) &&
+            ((revents & (POLLOUT | POLLWRNORM | POLLWRBAND)) ||
+             (!has_read && (revents & (POLLERR | POLLHUP))));
+
+        // Each event is checked to still be pending, as the handlers run
+        // before it may have cancelled it
+        if (has_priority && (PVEC[i].events & POLLPRI)) {
+            io_handler hnd = iosvc_dequeue(iosvc, node, WAIT_EXCEPTION, now, EIO_OK);
             hnd.callback(hnd.ctx);
+            served = 1;
         }
-        if ((!has_read && !has_write && has_error &&
-            (PVEC[i].events & ~POLLPRI) == POLLERR) || has_read) {
-            // Either got read, or read and write pending but
-            // got only error. Call read by convention
-            io_handler hnd = iosvc_dequeue(iosvc, *place, WAIT_READ, now, EIO_OK);
+        if (has_read && (PVEC[i].events & POLLIN)) {
+            io_handler hnd = iosvc_dequeue(iosvc, node, WAIT_READ, now, EIO_OK);
             hnd.callback(hnd.ctx);
+            served = 1;
         }
-        if (has_write) {
-            io_handler hnd = iosvc_dequeue(iosvc, *place, WAIT_WRITE, now, EIO_OK);
+        if (has_write && (PVEC[i].events & POLLOUT)) {
+            io_handler hnd = iosvc_dequeue(iosvc, node, WAIT_WRITE, now, EIO_OK);
             hnd.callback(hnd.ctx);
+            served = 1;
         }
 
-        if (PVEC[i].events == 0) {
-            ioevt_cleanup_evt(iosvc, place, parent);
-            continue;
+        *dispatched += (size_t)served;
+    }
+
+    return k;
+
+#undef PVEC
+}
+
+/**
+ * @brief Serve ready file descriptors, within the budget
+ * 
+ * @param iosvc service to dispatch events of
+ * @param now current time
+ * @return Number of file descriptors served
+ */
+static size_t dispatch_ready_events(io_service *iosvc, int64_t now) {
+    size_t dispatched = 0;
+
+    if (!iosvc->prio_fds) {
+        size_t npolled = dynarr_size(&iosvc->pollfds);
+        size_t k = dispatch_pass(iosvc, now, -1, iosvc->event_budget,
+                                 &dispatched);
+
+        // Resume after the last served FD if the budget ran out
+        iosvc->dispatch_start += (k < npolled ? k : 1);
+        return dispatched;
+    }
+
+    // Serve higher priorities first. Looking up priorities is only done if
+    // some FD has a priority other than normal. Each priority is served at
+    // least one FD even if the budget ran out, so that a constantly busy FD
+    // can not starve those of lower priorities
+    for (int prio = 0; prio < IO_PRIO_COUNT; ++prio) {
+        size_t budget = iosvc->event_budget;
+        size_t limit = (!budget) ? 0 :
+                       (dispatched < budget) ? budget : dispatched + 1;
+
+        dispatch_pass(iosvc, now, prio, limit, &dispatched);
+    }
+
+    ++iosvc->dispatch_start;
+    return dispatched;
+}
+
+/**
+ * @brief Check if the service has any pending work
+ * 
+ * @param iosvc service to check
+ * @return nonzero if work is pending
+ */
+static int has_work(io_service *iosvc) {
+    return !dynarr_empty(&iosvc->pollfds) ||
+           iosvc->timed_handlers_heap.size ||
+           iosvc->armed_tmos ||
+           next_sync_handlers(iosvc) ||
+           !dynarr_empty(&iosvc->corked_fds);
+}
+
+/**
+ * @brief Run a single iteration of the event loop. Stops the service if a
+ * stop was requested before waiting for events
+ * 
+ * @param iosvc service to run
+ * @param max_delay maximum time to wait for events, in milliseconds, or -1
+ * for no limit
+ * @param handled out parameter; incremented by the number of handlers run
+ * (ready file descriptors count once)
+ * @return nonzero if the service was stopped
+ */
+static int run_iteration(io_service *iosvc, int max_delay, size_t *handled) {
+    *handled += run_sync_handlers(iosvc);
+
+    // Idle hooks only run if the loop is about to wait, with nothing to do
+    // right away. Whatever they do is taken into account by the wait
+    if (hooks_present(iosvc, HOOK_IDLE) && iosvc_next_timeout(iosvc) != 0)
+        hooks_run(iosvc, HOOK_IDLE);
+
+    hooks_run(iosvc, HOOK_PREPARE);
+
+    // Coalesce writes issued during this iteration before polling
+    iosvc_flush_corked(iosvc);
+
+    if (iosvc->draining) {
+        int64_t now = current_time();
+
+        if (iosvc->draining == DRAIN_REQUESTED) {
+            iosvc->draining = DRAIN_ACTIVE;
+            drain_listeners(iosvc, now);
         }
 
-        ++i;
+        // Work left at the deadline is stopped
+        if (now >= iosvc->drain_deadline)
+            iosvc->status = STOPPING;
+    }
+
+    if (iosvc->status == STOPPING) {
+        iosvc_prep_stop(iosvc);
+        return 1;
     }
 
-#undef PVEC
+    // End of the iteration. Lingering registrations are not reused anymore
+    // by handlers of this iteration, and their FDs may be closed by now
+    ioevt_sweep_idle(iosvc);
+    capacity_autoshrink(iosvc);
+
+    if (dynarr_empty(&iosvc->pollfds) &&
+        !iosvc->timed_handlers_heap.size &&
+        !iosvc->armed_tmos)
+        return 0;
+
+    int queue;
+    int64_t deadline = next_deadline(iosvc, &queue);
+    int64_t poll_time = current_time();
+
+    if (iosvc->draining &&
+        (deadline == -1 || iosvc->drain_deadline < deadline))
+        deadline = iosvc->drain_deadline;
+
+    // Don't block if handlers are left over by the budget, or were
+    // posted by completion handlers of flushed writes. Absolute deadlines
+    // may be arbitrarily far away
+    int delay = next_sync_handlers(iosvc) ? 0 :
+                (deadline == -1) ? -1 :
+                (deadline - poll_time > INT_MAX) ? INT_MAX :
+                (deadline > poll_time) ? (int)(deadline - poll_time) :
+                0;
+
+    if (max_delay >= 0 && (delay < 0 || delay > max_delay))
+        delay = max_delay;
+
+    int ready_fds = busypoll_wait(iosvc, delay);
+    
+    int64_t completion_time = current_time();
+
+    if (ready_fds < 0 && errno != EINTR) {
+        iosvc->status = STOPPING;
+        return 0;
+    }
+
+    // Iterate through ready events. Timers are expired afterwards, so that
+    // a ready event never holds back timers due behind it
+    if (ready_fds > 0)
+        *handled += dispatch_ready_events(iosvc, completion_time);
+
+    *handled += expire_timers(iosvc, completion_time);
+
+    hooks_run(iosvc, HOOK_CHECK);
+
+    return 0;
 }
 
 io_errcode iosvc_run(io_service *iosvc) {
@@ -306,53 +815,88 @@ io_errcode iosvc_run(io_service *iosvc) {
 
     iosvc->status = RUNNING;
 
-    while (!dynarr_empty(&iosvc->pollfds) ||
-           !dynarr_empty(&iosvc->timed_handlers_heap) ||
-           !cbuf_empty(&iosvc->sync_handlers)) {
-        run_sync_handlers(iosvc);
+    size_t handled = 0;
 
-        if (iosvc->status == STOPPING) {
-            iosvc_prep_stop(iosvc);
+    while (has_work(iosvc))
+        if (run_iteration(iosvc, -1, &handled))
             break;
-        }
 
-        if (dynarr_empty(&iosvc->pollfds) &&
-            dynarr_empty(&iosvc->timed_handlers_heap))
-            continue;
+    // A drain that completed before its deadline stops the service too
+    io_errcode retval = (iosvc->status == RUNNING && !iosvc->draining) ?
+                        EIO_OK : EIO_STOPPED;
+    iosvc->status = DONE;
+    iosvc->draining = DRAIN_NONE;
 
-        int is_event;
-        int64_t deadline = next_deadline(iosvc, &is_event);
-        int64_t poll_time = current_time();
-        int delay = (deadline == -1) ? -1 :
-                    (deadline > poll_time) ? (int)(deadline - poll_time) :
-                    0;
-
-        int ready_fds = poll((struct pollfd *)dynarr_front(&iosvc->pollfds),
-                                dynarr_size(&iosvc->pollfds),
-                                delay);
-        
-        int64_t completion_time = current_time();
-        int64_t elapsed = completion_time - poll_time;
-
-        if (ready_fds < 0 && errno != EINTR) {
-            iosvc->status = STOPPING;
-            continue;
-        } else if (ready_fds == 0) {
-            timeout_first(iosvc, is_event, completion_time);
-        } else {
-            if ((int)elapsed >= delay && delay != -1 &&
-                (!is_event || !is_top_event_ready(iosvc))) {
-                timeout_first(iosvc, is_event, completion_time);
-            }
-            
-            // Iterate through ready events
-            dispatch_ready_events(iosvc, completion_time);
+    return retval;
+}
+
+/**
+ * @brief Run the event loop in steps, returning control to the caller when
+ * done, while leaving the service ready to be run again
+ * 
+ * @param iosvc service to run
+ * @param deadline time to stop waiting for events at, or -1 for no limit
+ * @param one_handler stop as soon as any handler was run
+ * @param handled out parameter; number of handlers run. Ignored if `NULL`
+ * @return Same as `iosvc_run_for()`
+ */
+static io_errcode run_steps(io_service *iosvc, int64_t deadline,
+                            int one_handler, size_t *handled) {
+    if (iosvc->status != READY)
+        return (iosvc->status == DONE) ? EIO_INVARG : EIO_INPROGRESS;
+
+    iosvc->status = RUNNING;
+
+    size_t ran = 0;
+    int stopped = 0;
+
+    while (!stopped && has_work(iosvc)) {
+        int max_delay = -1;
+
+        if (deadline >= 0) {
+            int64_t left = deadline - current_time();
+
+            max_delay = left <= 0 ? 0 : left > INT_MAX ? INT_MAX : (int)left;
         }
-        
+
+        stopped = run_iteration(iosvc, max_delay, &ran);
+
+        if ((one_handler && ran) || max_delay == 0)
+            break;
     }
 
-    io_errcode retval = (iosvc->status == RUNNING) ? EIO_OK : EIO_STOPPED;
-    iosvc->status = DONE;
+    // A stop requested by the last handlers is carried out right away, so
+    // that the service is not left stopping
+    if (!stopped && iosvc->status == STOPPING)
+        stopped = run_iteration(iosvc, 0, &ran);
 
-    return retval;
+    if (handled)
+        *handled = ran;
+
+    // Drained services are done once no work is left
+    if (stopped || iosvc->status == STOPPING ||
+        (iosvc->draining && !has_work(iosvc))) {
+        iosvc->status = DONE;
+        iosvc->draining = DRAIN_NONE;
+        return EIO_STOPPED;
+    }
+
+    iosvc->status = READY;
+    return EIO_OK;
+}
+
+io_errcode iosvc_poll(io_service *iosvc, size_t *handled) {
+    return run_steps(iosvc, 0, 0, handled);
+}
+
+io_errcode iosvc_run_one(io_service *iosvc, size_t *handled) {
+    return run_steps(iosvc, -1, 1, handled);
+}
+
+io_errcode iosvc_run_for(io_service *iosvc, int milliseconds,
+                         size_t *handled) {
+    if (milliseconds < 0)
+        return EIO_INVARG;
+
+    return run_steps(iosvc, current_time() + milliseconds, 0, handled);
 }
@@ -0,0 +1,42 @@
+#include "iomem.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void *default_alloc(void *ctx, size_t size, size_t align) {
+    (void)ctx;
+
+    if (align <= _Alignof(max_align_t))
+        return malloc(size);
+
+    // Allocation size must be a multiple of the alignment
+    return aligned_alloc(align, (size + align - 1) & ~(align - 1));
+}
+
+static void default_free(void *ctx, void *ptr, size_t size) {
+    (void)ctx;
+    (void)size;
+
+    free(ptr);
+}
+
+io_allocator const iomem_default = {default_alloc, default_free, NULL};
+
+void *iomem_realloc(io_allocator const *alc, void *ptr, size_t old_size,
+                    size_t new_size) {
+    // Blocks of the default allocator may be grown in place
+    if (alc->alloc == default_alloc)
+        return realloc(ptr, new_size);
+
+    void *new_ptr = iomem_alloc(alc, new_size, _Alignof(max_align_t));
+
+    if (!new_ptr)
+        return NULL;
+
+    if (ptr) {
+        memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+        iomem_free(alc, ptr, old_size);
+    }
+
+    return new_ptr;
+}
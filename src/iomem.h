@@ -0,0 +1,43 @@
+#ifndef IOMEM_H_
+#define IOMEM_H_ 1
+
+// Allocation through a service's `io_allocator`. Blocks are released with the
+// size they were allocated with, which is why containers track their
+// capacity in bytes, or allocate objects of fixed size.
+
+#include <stddef.h>
+
+#include "iotypes.h"
+
+/**
+ * @brief Allocator based on `malloc()` and `free()`, used by services created
+ * with `iosvc_create()`
+ */
+extern io_allocator const iomem_default;
+
+inline static void *iomem_alloc(io_allocator const *alc, size_t size,
+                                size_t align) {
+    return alc->alloc(alc->ctx, size, align);
+}
+
+inline static void iomem_free(io_allocator const *alc, void *ptr,
+                              size_t size) {
+    if (ptr)
+        alc->free(alc->ctx, ptr, size);
+}
+
+/**
+ * @brief Resize a block with default alignment, preserving its first
+ * `min(old_size, new_size)` bytes
+ * 
+ * @param alc allocator of the block
+ * @param ptr block to resize, or `NULL` if none was allocated yet
+ * @param old_size size of the block
+ * @param new_size requested size
+ * @return The resized block, or `NULL` if no memory could be allocated, in
+ * which case `ptr` is left untouched
+ */
+void *iomem_realloc(io_allocator const *alc, void *ptr, size_t old_size,
+                    size_t new_size);
+
+#endif // IOMEM_H_
@@ -0,0 +1,94 @@
+#include "iosvc_backend.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+
+/**
+ * @brief Convert poll() event flags to epoll ones
+ * 
+ * @param events poll() event flags
+ * @return Equivalent epoll event flags
+ */
+static uint32_t to_epoll_events(short events) {
+    uint32_t ep_events = 0;
+
+    if (events & POLLIN)
+        ep_events |= EPOLLIN;
+    if (events & POLLOUT)
+        ep_events |= EPOLLOUT;
+    if (events & POLLPRI)
+        ep_events |= EPOLLPRI;
+
+    return ep_events;
+}
+
+void backend_update_slow(io_service *iosvc, struct pollfd const *pfd) {
+    // Errors are ignored: the FD may already be closed, which removes it from
+    // the epoll set, and an invalid FD is reported by poll() anyway
+    if (pfd->events == 0) {
+        epoll_ctl(iosvc->backend_fd, EPOLL_CTL_DEL, pfd->fd, NULL);
+        return;
+    }
+
+    struct epoll_event ev = {
+        .events = to_epoll_events(pfd->events),
+        .data.fd = pfd->fd
+    };
+
+    if (epoll_ctl(iosvc->backend_fd, EPOLL_CTL_MOD, pfd->fd, &ev) < 0 &&
+        errno == ENOENT)
+        epoll_ctl(iosvc->backend_fd, EPOLL_CTL_ADD, pfd->fd, &ev);
+}
+
+int iosvc_get_fd(io_service *iosvc) {
+    if (iosvc->backend_fd >= 0)
+        return iosvc->backend_fd;
+
+    if ((iosvc->backend_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        return -1;
+
+    struct pollfd *pollvec = (struct pollfd *)dynarr_front(&iosvc->pollfds);
+
+    for (size_t i = 0; i < dynarr_size(&iosvc->pollfds); ++i)
+        backend_update_slow(iosvc, &pollvec[i]);
+
+    return iosvc->backend_fd;
+}
+
+#else
+
+void backend_update_slow(io_service *iosvc, struct pollfd const *pfd) {
+    (void)iosvc;
+    (void)pfd;
+}
+
+int iosvc_get_fd(io_service *iosvc) {
+    (void)iosvc;
+
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif // __linux__
+
+void backend_clear(io_service *iosvc) {
+    if (iosvc->backend_fd < 0)
+        return;
+
+    struct pollfd *pollvec = (struct pollfd *)dynarr_front(&iosvc->pollfds);
+
+    for (size_t i = 0; i < dynarr_size(&iosvc->pollfds); ++i) {
+        struct pollfd removed = {.fd = pollvec[i].fd, .events = 0};
+        backend_update_slow(iosvc, &removed);
+    }
+}
+
+void backend_close(io_service *iosvc) {
+    if (iosvc->backend_fd >= 0)
+        close(iosvc->backend_fd);
+
+    iosvc->backend_fd = -1;
+}
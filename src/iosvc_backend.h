@@ -0,0 +1,43 @@
+#ifndef IOSVC_BACKEND_H_
+#define IOSVC_BACKEND_H_ 1
+
+// Pollable descriptor mirroring the service's pollfds, for nesting the
+// service in foreign event loops. It is only created on request (see
+// `iosvc_get_fd()`); until then, keeping it in sync costs nothing. On Linux
+// it is an epoll instance, elsewhere it is not available
+
+#include <poll.h>
+
+#include "iosvc_def.h"
+
+/**
+ * @brief Mirror the events of a pollfd entry to the backend descriptor, if
+ * one was created
+ * 
+ * @param iosvc service owning the entry
+ * @param pfd entry whose events have changed. If its events are 0, the FD
+ * is removed from the backend
+ */
+void backend_update_slow(io_service *iosvc, struct pollfd const *pfd);
+
+inline static void backend_update(io_service *iosvc,
+                                  struct pollfd const *pfd) {
+    if (iosvc->backend_fd >= 0)
+        backend_update_slow(iosvc, pfd);
+}
+
+/**
+ * @brief Remove all FDs from the backend descriptor, if one was created
+ * 
+ * @param iosvc service whose pollfds are about to be cleared
+ */
+void backend_clear(io_service *iosvc);
+
+/**
+ * @brief Close the backend descriptor, if one was created
+ * 
+ * @param iosvc service being deleted
+ */
+void backend_close(io_service *iosvc);
+
+#endif // IOSVC_BACKEND_H_
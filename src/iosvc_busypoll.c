@@ -0,0 +1,109 @@
+#include "iosvc_busypoll.h"
+
+#include <poll.h>
+
+#include "heaputils.h"
+
+// Spin windows below this are not worth the setup
+#define SPIN_MIN_US 10
+
+// Weight of a new gap in the moving average is 1 / 2^GAP_SHIFT
+#define GAP_SHIFT 3
+
+io_errcode iosvc_set_busy_poll(io_service *iosvc, int max_spin_us) {
+    if (max_spin_us < 0)
+        return EIO_INVARG;
+
+    // Start by assuming that events arrive within the window
+    iosvc->spin_max_us = max_spin_us;
+    iosvc->idle_gap_us = max_spin_us / 2;
+
+    return EIO_OK;
+}
+
+void iosvc_get_poll_stats(io_service *iosvc, io_poll_stats *stats) {
+    *stats = iosvc->poll_stats;
+}
+
+/**
+ * @brief Account for the time waited for events in the moving average
+ * 
+ * @param iosvc service that waited
+ * @param gap time waited, in microseconds
+ */
+static void record_gap(io_service *iosvc, int64_t gap) {
+    iosvc->idle_gap_us += (gap - iosvc->idle_gap_us) / (1 << GAP_SHIFT);
+}
+
+/**
+ * @brief Compute how long to spin for before blocking
+ * 
+ * @param iosvc service about to wait
+ * @param delay maximum time to wait, in milliseconds (-1 for no limit)
+ * @return Spin window, in microseconds (0 for none)
+ */
+static int64_t spin_window(io_service *iosvc, int delay) {
+    int64_t max = iosvc->spin_max_us;
+
+    if (iosvc->idle_gap_us > max)
+        return 0;
+
+    int64_t window = 2 * iosvc->idle_gap_us;
+
+    if (window < SPIN_MIN_US)
+        window = SPIN_MIN_US;
+    if (window > max)
+        window = max;
+    if (delay >= 0 && window > delay * 1000L)
+        window = delay * 1000L;
+
+    return window;
+}
+
+int busypoll_wait(io_service *iosvc, int delay) {
+    struct pollfd *fds = (struct pollfd *)dynarr_front(&iosvc->pollfds);
+    nfds_t nfds = dynarr_size(&iosvc->pollfds);
+
+    // Spinning only helps with FD events, not with timers
+    if (!iosvc->spin_max_us || delay == 0 || nfds == 0)
+        return poll(fds, nfds, delay);
+
+    io_poll_stats *stats = &iosvc->poll_stats;
+    int64_t start = current_time_us();
+    int64_t spun_until = start;
+    int64_t window = spin_window(iosvc, delay);
+    int ready = 0;
+
+    if (window) {
+        do {
+            ready = poll(fds, nfds, 0);
+            spun_until = current_time_us();
+        } while (ready == 0 && spun_until - start < window);
+
+        stats->spin_us += (uint64_t)(spun_until - start);
+
+        if (ready != 0) {
+            ++stats->spin_wakeups;
+            record_gap(iosvc, spun_until - start);
+
+            return ready;
+        }
+
+        // Don't overshoot the deadline of the next timer
+        if (delay > 0) {
+            delay -= (int)((spun_until - start) / 1000L);
+            if (delay < 0)
+                delay = 0;
+        }
+    }
+
+    ready = poll(fds, nfds, delay);
+
+    int64_t end = current_time_us();
+
+    stats->blocked_us += (uint64_t)(end - spun_until);
+    ++stats->blocked_wakeups;
+    record_gap(iosvc, end - start);
+
+    return ready;
+}
@@ -0,0 +1,22 @@
+#ifndef IOSVC_BUSYPOLL_H_
+#define IOSVC_BUSYPOLL_H_ 1
+
+// Opt-in busy-polling. Before blocking in poll(), the service spins with
+// zero-timeout polls for a window that follows the recent gaps between
+// waiting for events and their arrival: spinning pays off only if events
+// tend to arrive within the window, so the window shrinks along with the
+// gaps, and is skipped altogether while gaps exceed the configured maximum
+
+#include "iosvc_def.h"
+
+/**
+ * @brief Wait for events on the service's pollfds, spinning first if
+ * busy-polling is enabled
+ * 
+ * @param iosvc service to wait on
+ * @param delay maximum time to wait, in milliseconds (-1 for no limit)
+ * @return Same as `poll()`
+ */
+int busypoll_wait(io_service *iosvc, int delay);
+
+#endif // IOSVC_BUSYPOLL_H_
@@ -1,11 +1,30 @@
 #include "iosvc_def.h"
 #include "iosvc_dequeue.h"
+#include "iosvc_opslot.h"
+#include "iosvc_delayed.h"
+#include "iosvc_tmoclass.h"
+#include "heaputils.h"
 #include "rbtree.h"
 
 #include <poll.h>
 
+/**
+ * @brief Dequeue a pending event with status `EIO_CANCELLED` and call its
+ * handler
+ * 
+ * @param iosvc service where the event is scheduled
+ * @param node node holding the event
+ * @param wait_type wait type of the event
+ */
+static void cancel_event(io_service *iosvc, rb_node *node,
+                         io_wait_type wait_type) {
+    io_handler hnd = iosvc_dequeue(iosvc, node, wait_type, current_time(),
+                                   EIO_CANCELLED);
+    hnd.callback(hnd.ctx);
+}
+
 io_errcode iosvc_cancel(io_service *iosvc, io_event event) {
-    if (iosvc->status != RUNNING)
+    if (iosvc->status != RUNNING && iosvc->status != READY)
         return EIO_INVARG;
 
     rb_place place;
@@ -15,21 +34,104 @@ io_errcode iosvc_cancel(io_service *iosvc, io_event event) {
     if (!(*place))
         return EIO_NOENTRY;
 
-    event_data *evt_data = get_evt_data(*place, event.wait_type);
+    if (!is_pending(*place, event.wait_type))
+        return EIO_NOENTRY;
+
+    cancel_event(iosvc, *place, event.wait_type);
+
+    return EIO_OK;
+}
+
+io_errcode iosvc_cancel_many(io_service *iosvc, io_event const *events,
+                             size_t count, size_t *cancelled) {
+    if (iosvc->status != RUNNING && iosvc->status != READY)
+        return EIO_INVARG;
+
+    size_t ncancelled = 0;
+
+    // Registrations left without events linger until the end of the loop
+    // iteration, so the tree is not reshaped while cancelling
+    for (size_t i = 0; i < count; ++i)
+        if (iosvc_cancel(iosvc, events[i]) == EIO_OK)
+            ++ncancelled;
 
-    if (!evt_data || !evt_data->handler.callback)
+    if (cancelled)
+        *cancelled = ncancelled;
+
+    return ncancelled == count ? EIO_OK : EIO_NOENTRY;
+}
+
+io_errcode iosvc_cancel_op(io_service *iosvc, io_op_handle op) {
+    if (iosvc->status != RUNNING && iosvc->status != READY)
+        return EIO_INVARG;
+
+    op_slot *slot = opslot_get(iosvc, op);
+    if (!slot)
         return EIO_NOENTRY;
 
-    io_handler hnd = iosvc_dequeue(iosvc, *place, event.wait_type,
-                                   0, EIO_CANCELLED);
+    if (slot->kind == OP_EVENT) {
+        cancel_event(iosvc, slot->node, slot->wait_type);
+        return EIO_OK;
+    }
+
+    if (slot->kind == OP_CLASS_DELAY) {
+        // Timeout class lists are doubly linked, so unlink right away
+        tmo_entry *ent = tmo_at(iosvc, slot->tmo_idx);
+        io_handler hnd = ent->hnd;
+        io_errcode *status = ent->status;
+
+        tmo_remove(iosvc, slot->tmo_idx);
+        opslot_free(iosvc, op.idx);
+
+        if (status)
+            *status = EIO_CANCELLED;
+
+        hnd.callback(hnd.ctx);
+        return EIO_OK;
+    }
+
+    // Delayed handlers are tombstoned, and discarded from the timers heap
+    // later on. Invalidate the handle right away, though, as the slot is
+    // still in use until then
+    io_handler hnd = slot->hnd;
+
+    if (slot->status)
+        *slot->status = EIO_CANCELLED;
+
+    slot->cancelled = 1;
+    ++slot->gen;
+    ++iosvc->cancelled_delays;
+
+    delayed_discard_cancelled(iosvc);
 
     hnd.callback(hnd.ctx);
 
-    // Check if any more ops are pending for current FD
+    return EIO_OK;
+}
+
+io_errcode iosvc_release_fd(io_service *iosvc, int fd) {
+    if (iosvc->status != RUNNING && iosvc->status != READY)
+        return EIO_INVARG;
+
+    rb_node *parent;
+    rb_place place = rb_probe(&iosvc->async_handlers, &parent, fd);
+
+    if (!(*place))
+        return EIO_NOENTRY;
+
     struct pollfd *pollvec = (struct pollfd *)dynarr_front(&iosvc->pollfds);
 
-    if (pollvec[(*place)->pollfd_idx].events == 0)
+    if (pollvec[(*place)->pollfd_idx].events)
+        return EIO_INPROGRESS;
+
+    // While running, pollfds and nodes must stay in place, as handlers of
+    // the current iteration may still refer to them. The registration is
+    // marked as lingering then, so that the sweep at the end of the
+    // iteration releases it
+    if (iosvc->status == READY)
         ioevt_cleanup_evt(iosvc, place, parent);
+    else
+        ioevt_link_idle(iosvc, *place);
 
     return EIO_OK;
 }
@@ -0,0 +1,113 @@
+#include "iosvc_capacity.h"
+#include "iosvc_tmoclass.h"
+
+#define SHRINK_MIN_CAPACITY 64 // Smaller containers are not worth shrinking
+#define SHRINK_RATIO        4  // Shrink once less than 1 / 4 is used
+
+inline static size_t mx(size_t a, size_t b) {
+    return a < b ? b : a;
+}
+
+/**
+ * @brief Compute the capacity to shrink a container to
+ * 
+ * @param size number of elements in the container
+ * @param capacity capacity of the container
+ * @param floor capacity reserved for the container
+ * @return The new capacity, or 0 if the container should be left as is
+ */
+inline static size_t shrink_target(size_t size, size_t capacity,
+                                   size_t floor) {
+    if (capacity <= SHRINK_MIN_CAPACITY || capacity <= floor ||
+        size >= capacity / SHRINK_RATIO)
+        return 0;
+
+    return mx(mx(2 * size, SHRINK_MIN_CAPACITY), floor);
+}
+
+void capacity_autoshrink(io_service *iosvc) {
+    if (iosvc->fixed_capacity)
+        return;
+
+    io_capacity *floor = &iosvc->reserved;
+    size_t target;
+
+    // Failures to shrink are harmless, and retried on the next iteration
+    if ((target = shrink_target(dynarr_size(&iosvc->pollfds),
+                                iosvc->pollfds.capacity, floor->fds))) {
+        (void)dynarr_shrink(&iosvc->pollfds, target);
+        (void)dynarr_shrink(&iosvc->pollfd_nodes, target);
+    }
+
+    async_heap *evt_heap = &iosvc->timed_events_heap;
+    if ((target = shrink_target(evt_heap->size, evt_heap->capacity,
+                                floor->timers)))
+        (void)async_heap_shrink(evt_heap, target);
+
+    delay_heap *hnd_heap = &iosvc->timed_handlers_heap;
+    if ((target = shrink_target(hnd_heap->size, hnd_heap->capacity,
+                                floor->timers)))
+        (void)delay_heap_shrink(hnd_heap, target);
+
+    for (int i = 0; i < IO_PRIO_COUNT; ++i) {
+        cbuffer *queue = &iosvc->sync_handlers[i];
+
+        if ((target = shrink_target(cbuf_size(queue), cbuf_capacity(queue),
+                                    floor->handlers)))
+            (void)cbuf_shrink(queue, target);
+    }
+}
+
+io_errcode iosvc_reserve(io_service *iosvc, io_capacity const *capacity) {
+    int rc = 0;
+
+    rc |= dynarr_reserve(&iosvc->pollfds, capacity->fds);
+    rc |= dynarr_reserve(&iosvc->pollfd_nodes, capacity->fds);
+
+    rc |= async_heap_reserve(&iosvc->timed_events_heap, capacity->timers);
+    rc |= delay_heap_reserve(&iosvc->timed_handlers_heap, capacity->timers);
+    rc |= dynarr_reserve(&iosvc->tmo_entries, capacity->timers);
+
+    for (int i = 0; i < IO_PRIO_COUNT; ++i)
+        rc |= cbuf_reserve(&iosvc->sync_handlers[i], capacity->handlers);
+
+    rc |= dynarr_reserve(&iosvc->op_slots, capacity->handles);
+
+    iosvc->reserved = *capacity;
+
+    return rc ? EIO_NOMEM : EIO_OK;
+}
+
+io_errcode iosvc_trim(io_service *iosvc) {
+    int rc = 0;
+
+    iosvc->reserved = (io_capacity){0};
+
+    rc |= dynarr_shrink(&iosvc->pollfds, 0);
+    rc |= dynarr_shrink(&iosvc->pollfd_nodes, 0);
+    rc |= dynarr_shrink(&iosvc->fd_opts, 0);
+    rc |= dynarr_shrink(&iosvc->corked_fds, 0);
+
+    rc |= async_heap_shrink(&iosvc->timed_events_heap, 0);
+    rc |= delay_heap_shrink(&iosvc->timed_handlers_heap, 0);
+
+    for (int i = 0; i < IO_PRIO_COUNT; ++i)
+        rc |= cbuf_shrink(&iosvc->sync_handlers[i], 0);
+
+    // Released slots keep their generation, so that stale handles never
+    // match a reused slot. Only the spare capacity is released
+    rc |= dynarr_shrink(&iosvc->op_slots, 0);
+
+    // Armed entries are referred to by index, so the table can only be
+    // emptied once no class timer is armed
+    if (!iosvc->armed_tmos)
+        tmo_clear(iosvc);
+
+    rc |= dynarr_shrink(&iosvc->tmo_entries, 0);
+    rc |= dynarr_shrink(&iosvc->tmo_classes, 0);
+
+    for (int i = 0; i < IO_HOOK_COUNT; ++i)
+        rc |= dynarr_shrink(&iosvc->loop_hooks[i], 0);
+
+    return rc ? EIO_NOMEM : EIO_OK;
+}
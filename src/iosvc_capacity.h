@@ -0,0 +1,20 @@
+#ifndef IOSVC_CAPACITY_H_
+#define IOSVC_CAPACITY_H_ 1
+
+// Sizing of the containers of a service. Containers grow on demand, or
+// upfront through `iosvc_reserve()`, and are shrunk once mostly unused, with
+// hysteresis: a container is shrunk when less than a quarter of it is used,
+// to twice its size, so that it must double again before growing.
+
+#include "iosvc_def.h"
+
+/**
+ * @brief Shrink the containers of a service that are mostly unused, down to
+ * no less than the capacity reserved through `iosvc_reserve()`. Called once
+ * per loop iteration, outside of dispatch
+ * 
+ * @param iosvc service to shrink the containers of
+ */
+void capacity_autoshrink(io_service *iosvc);
+
+#endif // IOSVC_CAPACITY_H_
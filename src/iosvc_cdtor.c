@@ -5,44 +5,155 @@
 
 #include "async_heap_entry.h"
 #include "delay_heap_entry.h"
+#include "iosvc_fdopt.h"
+#include "iosvc_opslot.h"
+#include "iosvc_tmoclass.h"
+#include "iosvc_backend.h"
+#include "iosvc_nodepool.h"
+#include "iomem.h"
 
 io_service *iosvc_create() {
-    io_service *iosvc = (io_service *)malloc(sizeof(*iosvc));
+    return iosvc_create_with_allocator(NULL);
+}
+
+io_service *iosvc_create_with_allocator(io_allocator const *allocator) {
+    if (!allocator)
+        allocator = &iomem_default;
+    else if (!allocator->alloc || !allocator->free)
+        return NULL;
+
+    io_service *iosvc = (io_service *)iomem_alloc(allocator, sizeof(*iosvc),
+                                                  _Alignof(io_service));
     if (!iosvc)
         return NULL;
 
-    cbuf_init(&iosvc->sync_handlers, sizeof(io_handler));
-    dynarr_init(&iosvc->pollfds, sizeof(struct pollfd));
+    // Containers refer to the service's copy, as `allocator` may be released
+    // by the caller
+    iosvc->allocator = *allocator;
+    io_allocator const *alc = &iosvc->allocator;
+
+    for (int i = 0; i < IO_PRIO_COUNT; ++i)
+        cbuf_init(&iosvc->sync_handlers[i], sizeof(io_handler), alc);
+
+    dynarr_init(&iosvc->pollfds, sizeof(struct pollfd), alc);
+    dynarr_init(&iosvc->pollfd_nodes, sizeof(rb_node *), alc);
 
     iosvc->async_handlers = NULL;
+    iosvc->idle_nodes = NULL;
     iosvc->status = READY;
+    iosvc->draining = DRAIN_NONE;
+    iosvc->drain_deadline = 0;
+
+    async_heap_init(&iosvc->timed_events_heap, alc);
+    delay_heap_init(&iosvc->timed_handlers_heap, alc);
+
+    dynarr_init(&iosvc->op_slots, sizeof(op_slot), alc);
+    iosvc->free_op_slot = OPSLOT_NONE;
+    iosvc->cancelled_delays = 0;
 
-    dynarr_init(&iosvc->timed_events_heap, sizeof(async_heap_entry));
-    dynarr_init(&iosvc->timed_handlers_heap, sizeof(delay_heap_entry));
+    dynarr_init(&iosvc->tmo_classes, sizeof(tmo_class), alc);
+    dynarr_init(&iosvc->tmo_entries, sizeof(tmo_entry), alc);
+    iosvc->free_tmo = TMO_NONE;
+    iosvc->armed_tmos = 0;
+
+    iosvc->handler_budget = 0;
+    iosvc->event_budget = 0;
+    iosvc->timer_budget = 0;
+    iosvc->dispatch_start = 0;
+
+    iosvc->spin_max_us = 0;
+    iosvc->idle_gap_us = 0;
+    iosvc->poll_stats = (io_poll_stats){0};
+
+    iosvc->backend_fd = -1;
+
+    iosvc->fixed_capacity = 0;
+    iosvc->node_pool = NULL;
+    iosvc->cold_pool = NULL;
+    iosvc->pool_size = 0;
+    iosvc->free_nodes = NULL;
+    iosvc->cork_capacity = 0;
+    iosvc->reserved = (io_capacity){0};
+
+    for (int i = 0; i < IO_HOOK_COUNT; ++i)
+        dynarr_init(&iosvc->loop_hooks[i], sizeof(io_handler), alc);
+    iosvc->running_hooks = -1;
+
+    dynarr_init(&iosvc->fd_opts, sizeof(fd_opt *), alc);
+    iosvc->prio_fds = 0;
+    dynarr_init(&iosvc->corked_fds, sizeof(int), alc);
 
     return iosvc;
 }
 
-static void del_rb_node(rb_node *node) {
-    if (!node)
-        return;
+io_service *iosvc_create_fixed(io_capacity const *capacity,
+                               io_allocator const *allocator) {
+    if (!capacity)
+        return NULL;
 
-    free(node->aux_event);
-    free(node->ex_event);
+    io_service *iosvc = iosvc_create_with_allocator(allocator);
+    if (!iosvc)
+        return NULL;
+
+    iosvc->fixed_capacity = 1;
+    iosvc->cork_capacity = capacity->corked_writes;
+
+    int rc = nodepool_init(iosvc, capacity->fds);
+
+    for (int i = 0; i < IO_PRIO_COUNT; ++i)
+        rc |= cbuf_make_fixed(&iosvc->sync_handlers[i], capacity->handlers);
+
+    rc |= dynarr_make_fixed(&iosvc->pollfds, capacity->fds);
+    rc |= dynarr_make_fixed(&iosvc->pollfd_nodes, capacity->fds);
+    rc |= dynarr_make_fixed(&iosvc->fd_opts, capacity->fds);
+    rc |= dynarr_make_fixed(&iosvc->corked_fds, capacity->fds);
+
+    rc |= async_heap_make_fixed(&iosvc->timed_events_heap, capacity->timers);
+    rc |= delay_heap_make_fixed(&iosvc->timed_handlers_heap,
+                                capacity->timers);
+    rc |= dynarr_make_fixed(&iosvc->tmo_entries, capacity->timers);
 
-    del_rb_node(node->left);
-    del_rb_node(node->right);
+    rc |= dynarr_make_fixed(&iosvc->op_slots, capacity->handles);
 
-    free(node);
+    if (rc) {
+        iosvc_delete(iosvc);
+        return NULL;
+    }
+
+    return iosvc;
 }
 
 void iosvc_delete(io_service *iosvc) {
-    dynarr_delete(&iosvc->timed_events_heap);
-    dynarr_delete(&iosvc->timed_handlers_heap);
+    async_heap_delete(&iosvc->timed_events_heap);
+    delay_heap_delete(&iosvc->timed_handlers_heap);
+
+    // Every node has a pollfd, so nodes are released without walking the
+    // tree. Pooled nodes are released along with their pool
+    if (iosvc->fixed_capacity) {
+        nodepool_delete(iosvc);
+    } else {
+        for (size_t i = 0; i < dynarr_size(&iosvc->pollfd_nodes); ++i)
+            free_rbnode(&iosvc->allocator,
+                        *(rb_node **)dynarr_at(&iosvc->pollfd_nodes, i));
+    }
 
     dynarr_delete(&iosvc->pollfds);
-    cbuf_delete(&iosvc->sync_handlers);
+    dynarr_delete(&iosvc->pollfd_nodes);
+    for (int i = 0; i < IO_PRIO_COUNT; ++i)
+        cbuf_delete(&iosvc->sync_handlers[i]);
+
+    dynarr_delete(&iosvc->op_slots);
+    dynarr_delete(&iosvc->tmo_classes);
+    dynarr_delete(&iosvc->tmo_entries);
+
+    fdopt_delete_all(iosvc);
+    dynarr_delete(&iosvc->fd_opts);
+    dynarr_delete(&iosvc->corked_fds);
+    backend_close(iosvc);
+
+    for (int i = 0; i < IO_HOOK_COUNT; ++i)
+        dynarr_delete(&iosvc->loop_hooks[i]);
 
-    del_rb_node(iosvc->async_handlers);
-    free(iosvc);
+    io_allocator allocator = iosvc->allocator;
+    iomem_free(&allocator, iosvc, sizeof(*iosvc));
 }
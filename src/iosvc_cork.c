@@ -0,0 +1,262 @@
+#include "iosvc_cork.h"
+#include "iosvc_fdopt.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#if defined(IOV_MAX)
+#define CORK_IOV_LIMIT IOV_MAX
+#else
+#define CORK_IOV_LIMIT 16
+#endif
+
+static void flush_fd(fd_opt *opt);
+
+/**
+ * @brief Fail all pending writes of an FD, calling their handlers
+ * 
+ * @param opt settings of FD whose writes to fail
+ * @param status status to signal to the handlers
+ */
+static void fail_pending(fd_opt *opt, io_errcode status) {
+    while (!cbuf_empty(&opt->cork_queue)) {
+        cork_write wr = *(cork_write *)cbuf_front(&opt->cork_queue);
+        cbuf_pop(&opt->cork_queue);
+
+        *wr.errc = status;
+        wr.hnd.callback(wr.hnd.ctx);
+    }
+}
+
+static void cork_writable(void *arg) {
+    fd_opt *opt = (fd_opt *)arg;
+
+    opt->cork_waiting = 0;
+
+    if (opt->wait_status == EIO_OK) {
+        flush_fd(opt);
+        return;
+    }
+
+    opt->cork_busy = 1;
+    fail_pending(opt, opt->wait_status);
+    opt->cork_busy = 0;
+
+    fdopt_release(opt->iosvc, opt);
+}
+
+/**
+ * @brief Await writability of an FD whose pending writes could not be
+ * flushed entirely
+ * 
+ * @param opt settings of FD to wait for
+ * @return `EIO_OK` if the wait was scheduled, error code otherwise
+ */
+static io_errcode wait_writable(fd_opt *opt) {
+    io_errcode errc = iosvc_sched(opt->iosvc,
+                                  (io_event){opt->fd, WAIT_WRITE},
+                                  (io_handler){cork_writable, opt},
+                                  &opt->wait_status);
+
+    if (!errc)
+        opt->cork_waiting = 1;
+
+    return errc;
+}
+
+/**
+ * @brief Complete the writes covered by a partial or total flush, calling
+ * their handlers
+ * 
+ * @param opt settings of flushed FD
+ * @param written number of bytes written by the flush
+ */
+static void complete_written(fd_opt *opt, size_t written) {
+    while (!cbuf_empty(&opt->cork_queue)) {
+        cork_write *wr = (cork_write *)cbuf_front(&opt->cork_queue);
+
+        if (wr->nbytes > written) {
+            wr->buf = (char const *)wr->buf + written;
+            wr->nbytes -= written;
+            *wr->transferred += written;
+            return;
+        }
+
+        written -= wr->nbytes;
+        *wr->transferred += wr->nbytes;
+
+        // Handler might queue more writes (reallocating the queue),
+        // so pop before calling it
+        io_handler hnd = wr->hnd;
+        *wr->errc = EIO_OK;
+        cbuf_pop(&opt->cork_queue);
+
+        hnd.callback(hnd.ctx);
+    }
+}
+
+static void flush_fd(fd_opt *opt) {
+    struct iovec iov[CORK_IOV_LIMIT];
+
+    opt->cork_busy = 1;
+
+    while (!opt->cork_waiting && !cbuf_empty(&opt->cork_queue)) {
+        size_t niov = cbuf_size(&opt->cork_queue);
+        size_t total = 0;
+
+        if (niov > CORK_IOV_LIMIT)
+            niov = CORK_IOV_LIMIT;
+
+        for (size_t i = 0; i < niov; ++i) {
+            cork_write *wr = (cork_write *)cbuf_at(&opt->cork_queue, i);
+
+            iov[i] = (struct iovec){
+                .iov_base = (void *)wr->buf,
+                .iov_len = wr->nbytes
+            };
+            total += wr->nbytes;
+        }
+
+        ssize_t written = writev(opt->fd, iov, (int)niov);
+
+        if (written < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                fail_pending(opt, EIO_SYSERR);
+                break;
+            }
+
+            written = 0;
+        }
+
+        complete_written(opt, (size_t)written);
+
+        // A short write means the FD can not take more data for now
+        if ((size_t)written < total && !cbuf_empty(&opt->cork_queue)) {
+            io_errcode errc = wait_writable(opt);
+
+            if (errc)
+                fail_pending(opt, errc);
+        }
+    }
+
+    opt->cork_busy = 0;
+    fdopt_release(opt->iosvc, opt);
+}
+
+/**
+ * @brief Find the settings of an FD whose writes are corked
+ * 
+ * @param iosvc service to search
+ * @param fd file descriptor
+ * @return settings of `fd`, or `NULL` if its writes are not corked
+ */
+static fd_opt *find_corked(io_service *iosvc, int fd) {
+    if (dynarr_empty(&iosvc->fd_opts))
+        return NULL;
+
+    // Writes keep being corked after disabling, until the pending ones are
+    // flushed, so that they are not reordered
+    fd_opt *opt = fdopt_find(iosvc, fd);
+    if (!opt || (!(opt->flags & FDOPT_AUTOCORK) &&
+                 cbuf_empty(&opt->cork_queue) && !opt->cork_waiting))
+        return NULL;
+
+    return opt;
+}
+
+int iosvc_is_corked(io_service *iosvc, int fd) {
+    return find_corked(iosvc, fd) != NULL;
+}
+
+io_errcode iosvc_cork_write(io_service *iosvc, int fd, void const *buf,
+                            size_t nbytes, io_handler const *hnd,
+                            size_t *transferred, io_errcode *errc) {
+    fd_opt *opt = find_corked(iosvc, fd);
+    if (!opt)
+        return EIO_NOENTRY;
+
+    if (iosvc->status != READY && iosvc->status != RUNNING)
+        return EIO_STOPPED;
+
+    if (!hnd->callback)
+        return EIO_INVARG;
+
+    int queue_fd = !opt->cork_queued && !opt->cork_waiting;
+
+    if (queue_fd) {
+        int *pos = (int *)dynarr_emplace_back(&iosvc->corked_fds);
+        if (!pos)
+            return EIO_NOMEM;
+
+        *pos = fd;
+    }
+
+    cork_write *wr = (cork_write *)cbuf_push(&opt->cork_queue);
+    if (!wr) {
+        // The FD was appended last, and has nothing to flush
+        if (queue_fd)
+            dynarr_pop_back(&iosvc->corked_fds);
+
+        return EIO_NOMEM;
+    }
+
+    if (queue_fd)
+        opt->cork_queued = 1;
+
+    *wr = (cork_write){
+        .buf = buf,
+        .nbytes = nbytes,
+        .transferred = transferred,
+        .errc = errc,
+        .hnd = *hnd
+    };
+    *transferred = 0;
+
+    return EIO_OK;
+}
+
+void iosvc_flush_corked(io_service *iosvc) {
+    // Handlers called while flushing may queue writes on other FDs, which
+    // appends them to the list, so its size is re-read on every iteration
+    for (size_t i = 0; i < dynarr_size(&iosvc->corked_fds); ++i) {
+        int fd = *(int *)dynarr_at(&iosvc->corked_fds, i);
+        fd_opt *opt = fdopt_find(iosvc, fd);
+
+        if (!opt)
+            continue;
+
+        opt->cork_queued = 0;
+        if (!opt->cork_busy)
+            flush_fd(opt);
+    }
+
+    dynarr_clear(&iosvc->corked_fds);
+}
+
+io_errcode iosvc_set_autocork(io_service *iosvc, int fd, int enable) {
+    if (!enable) {
+        fd_opt *opt = fdopt_find(iosvc, fd);
+
+        if (opt) {
+            opt->flags &= ~FDOPT_AUTOCORK;
+            fdopt_release(iosvc, opt);
+        }
+
+        return EIO_OK;
+    }
+
+    fd_opt *opt = fdopt_get(iosvc, fd);
+    if (!opt)
+        return EIO_NOMEM;
+
+    // Queued writes never allocate in fixed capacity mode
+    if (iosvc->fixed_capacity && !opt->cork_queue.fixed &&
+        cbuf_make_fixed(&opt->cork_queue, iosvc->cork_capacity) < 0) {
+        fdopt_release(iosvc, opt);
+        return EIO_NOMEM;
+    }
+
+    opt->flags |= FDOPT_AUTOCORK;
+    return EIO_OK;
+}
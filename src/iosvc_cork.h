@@ -0,0 +1,56 @@
+#ifndef IOSVC_CORK_H_
+#define IOSVC_CORK_H_ 1
+
+// Used by async writes and iosvc_run, to coalesce writes issued on
+// auto-corked FDs during a loop iteration
+
+#include <stddef.h>
+
+#include "iosvc_def.h"
+
+typedef struct cork_write {
+    void const *buf;
+    size_t nbytes;
+    size_t *transferred;
+    io_errcode *errc;
+    io_handler hnd;
+} cork_write;
+
+/**
+ * @brief Queue a write on an auto-corked FD, to be flushed at the end of the
+ * current loop iteration
+ * 
+ * @param iosvc service to queue the write on
+ * @param fd file descriptor to write to
+ * @param buf buffer to write from
+ * @param nbytes number of bytes to write
+ * @param hnd completion handler
+ * @param transferred out parameter; number of bytes written
+ * @param errc out parameter; completion status
+ * @return `EIO_NOENTRY` if `fd` is not auto-corked (the write must be
+ * scheduled normally), otherwise same as `async_write()`
+ */
+io_errcode iosvc_cork_write(io_service *iosvc, int fd, void const *buf,
+                            size_t nbytes, io_handler const *hnd,
+                            size_t *transferred, io_errcode *errc);
+
+/**
+ * @brief Check whether writes issued on an FD are corked, i.e. whether it is
+ * auto-corked, or still has corked writes pending
+ * 
+ * @param iosvc service to check
+ * @param fd file descriptor
+ * @return nonzero if writes on `fd` are corked, zero otherwise
+ */
+int iosvc_is_corked(io_service *iosvc, int fd);
+
+/**
+ * @brief Flush all writes queued on auto-corked FDs, calling the handlers of
+ * fully written ones. FDs that can not take all their data are flushed
+ * further once writable.
+ * 
+ * @param iosvc service whose corked writes to flush
+ */
+void iosvc_flush_corked(io_service *iosvc);
+
+#endif // IOSVC_CORK_H_
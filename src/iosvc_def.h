@@ -6,15 +6,74 @@
 #include "dynarray.h"
 #include "cbuffer.h"
 #include "rbnode.h"
+#include "async_heap_entry.h"
+#include "delay_heap_entry.h"
+
+#define IO_PRIO_COUNT 3
+#define IO_HOOK_COUNT 3
 
 struct io_service {
-    cbuffer sync_handlers;
-    dynarray timed_handlers_heap;
+    io_allocator allocator; // Of all memory owned by the service
+
+    cbuffer sync_handlers[IO_PRIO_COUNT]; // Indexed by io_priority
+    delay_heap timed_handlers_heap;
 
     dynarray pollfds;
-    dynarray timed_events_heap;
+    dynarray pollfd_nodes; // rb_node *, node of each pollfd, by index
+    async_heap timed_events_heap;
 
     rb_node *async_handlers;
+    rb_node *idle_nodes; // Registrations left with no events, until swept
+
+    dynarray op_slots;     // op_slot, backing io_op_handles
+    uint32_t free_op_slot; // Head of the free slots list
+
+    size_t cancelled_delays; // Tombstones in timed_handlers_heap
+
+    dynarray tmo_classes; // tmo_class, indexed by class ID
+    dynarray tmo_entries; // tmo_entry, linked in per-class FIFO lists
+    uint32_t free_tmo;    // Head of the free entries list
+    size_t armed_tmos;
+
+    // Per-iteration limits of the event loop (0 for unlimited)
+    size_t handler_budget;
+    size_t event_budget;
+    size_t timer_budget;
+    size_t dispatch_start; // Ready FDs are served starting from this index
+
+    // Busy-polling state
+    int spin_max_us;     // 0 if disabled
+    int64_t idle_gap_us; // Moving average of the time waited for events
+    io_poll_stats poll_stats;
+
+    int backend_fd; // Pollable descriptor for embedding, -1 until requested
+
+    // Fixed capacity mode. Event nodes come from a preallocated pool, each
+    // with a cold state of its own, and containers never grow
+    int fixed_capacity;
+    rb_node *node_pool;
+    fd_cold *cold_pool;
+    size_t pool_size;
+    rb_node *free_nodes;  // Linked through `left`
+    size_t cork_capacity; // Writes queued per auto-corked FD
+
+    io_capacity reserved; // Containers are not shrunk below it
+
+    dynarray loop_hooks[IO_HOOK_COUNT]; // io_handler, indexed by hook kind
+    int running_hooks;                  // Kind of hooks being run, or -1
+
+    dynarray fd_opts;    // fd_opt *, sorted by FD
+    size_t prio_fds;     // FDs with a priority other than IO_PRIO_NORMAL
+    dynarray corked_fds; // int, auto-corked FDs with unflushed writes
+
+    // Graceful stop, requested by `iosvc_drain()`. Listeners are closed to
+    // new events once the loop notices the request
+    enum {
+        DRAIN_NONE,
+        DRAIN_REQUESTED,
+        DRAIN_ACTIVE
+    } draining;
+    int64_t drain_deadline; // Work left by then is stopped
 
     enum {
         READY,
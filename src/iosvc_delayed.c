@@ -0,0 +1,61 @@
+#include "iosvc_delayed.h"
+#include "iosvc_opslot.h"
+
+
+// Compacting small heaps is not worth it
+#define DELAYED_COMPACT_MIN 64
+
+void delayed_pop(io_service *iosvc) {
+    delay_heap_pop(&iosvc->timed_handlers_heap);
+}
+
+int delayed_is_cancelled(io_service *iosvc, delay_heap_entry const *ent) {
+    return ent->op_slot != OPSLOT_NONE &&
+           opslot_at(iosvc, ent->op_slot)->cancelled;
+}
+
+/**
+ * @brief Remove all cancelled handlers from the heap, then restore the heap
+ * property
+ * 
+ * @param iosvc service whose heap to compact
+ */
+static void compact(io_service *iosvc) {
+    delay_heap *heap = &iosvc->timed_handlers_heap;
+    size_t kept = 0;
+
+    for (size_t i = 0; i < heap->size; ++i) {
+        if (delayed_is_cancelled(iosvc, &heap->ents[i])) {
+            opslot_free(iosvc, heap->ents[i].op_slot);
+        } else {
+            heap->keys[kept] = heap->keys[i];
+            heap->ents[kept++] = heap->ents[i];
+        }
+    }
+
+    heap->size = kept;
+    iosvc->cancelled_delays = 0;
+
+    delay_heap_make(heap);
+}
+
+void delayed_discard_cancelled(io_service *iosvc) {
+    delay_heap *heap = &iosvc->timed_handlers_heap;
+
+    if (iosvc->cancelled_delays >= DELAYED_COMPACT_MIN &&
+        2 * iosvc->cancelled_delays >= heap->size) {
+        compact(iosvc);
+        return;
+    }
+
+    while (iosvc->cancelled_delays && heap->size) {
+        delay_heap_entry *top = &heap->ents[0];
+
+        if (!delayed_is_cancelled(iosvc, top))
+            break;
+
+        opslot_free(iosvc, top->op_slot);
+        delayed_pop(iosvc);
+        --iosvc->cancelled_delays;
+    }
+}
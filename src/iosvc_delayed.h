@@ -0,0 +1,39 @@
+#ifndef IOSVC_DELAYED_H_
+#define IOSVC_DELAYED_H_ 1
+
+// Maintenance of the delayed handlers heap. Cancelled delayed handlers are
+// tombstoned in place, as their position in the heap is not tracked. They
+// are dropped as soon as they reach the top, and the heap is compacted once
+// they make up most of it, so that its size stays proportional to the number
+// of live timers
+
+#include "iosvc_def.h"
+#include "delay_heap_entry.h"
+
+/**
+ * @brief Pop the top of the delayed handlers heap. Its handle slot (if any)
+ * is left untouched
+ * 
+ * @param iosvc service whose heap to pop
+ */
+void delayed_pop(io_service *iosvc);
+
+/**
+ * @brief Check if a delayed handler was cancelled
+ * 
+ * @param iosvc service holding the handler
+ * @param ent heap entry of handler
+ * @return nonzero if cancelled
+ */
+int delayed_is_cancelled(io_service *iosvc, delay_heap_entry const *ent);
+
+/**
+ * @brief Drop cancelled handlers from the top of the heap, and compact the
+ * heap if cancelled handlers make up most of it. Releases the handle slots
+ * of dropped handlers
+ * 
+ * @param iosvc service whose heap to clean up
+ */
+void delayed_discard_cancelled(io_service *iosvc);
+
+#endif // IOSVC_DELAYED_H_
@@ -1,6 +1,10 @@
 #include "iosvc_dequeue.h"
 #include "async_heap_entry.h"
 #include "heaputils.h"
+#include "iosvc_opslot.h"
+#include "iosvc_tmoclass.h"
+#include "iosvc_backend.h"
+#include "iosvc_nodepool.h"
 
 #include <poll.h>
 
@@ -10,42 +14,50 @@ io_handler iosvc_dequeue(io_service *iosvc, rb_node *fd_node,
 {
     event_data *evt_data = get_evt_data(fd_node, event_type);
     io_handler hnd = evt_data->handler;
+    io_errcode *status_ptr = evt_data->status;
 
     ptrdiff_t heap_idx = evt_data->ddl_heap_idx;
 
-    // Signal remaining time for operation and pop from events heap
+    // Signal remaining time for operation and remove from events heap
     if (heap_idx >= 0) {
-        dynarray *heap = &iosvc->timed_events_heap;
-        async_heap_entry *heap_ent =
-            &((async_heap_entry *)heap->data)[heap_idx];
+        async_heap *heap = &iosvc->timed_events_heap;
+        async_heap_entry *heap_ent = &heap->ents[heap_idx];
+        int64_t deadline = heap->keys[heap_idx];
 
-        int remaining = heap_ent->deadline > now ?
-            (int)(heap_ent->deadline - now) :
-            0;
-        *heap_ent->remaining = remaining;
+        if (heap_ent->remaining)
+            *heap_ent->remaining = deadline > now ?
+                (int)(deadline - now) :
+                0;
 
-        // Pop heap entry
-
-        heap_ent->deadline = -1; // Value lower than all entries, to move to top
-        heap_sift_up_idx(heap, (size_t)heap_idx,
-                         async_hp_ent_lt, async_hp_ent_swp);
-
-        async_hp_ent_swp(dynarr_front(heap), dynarr_back(heap));
-        dynarr_pop_back(heap);
-
-        if (!dynarr_empty(heap))
-            heap_sift_down_idx(heap, 0, async_hp_ent_lt, async_hp_ent_swp);
+        async_heap_remove(heap, (size_t)heap_idx);
     }
 
     // Vacate event data storage
     evt_data->handler.callback = NULL;
 
-    if (evt_data->status)
-        *evt_data->status = status;
+    // Handles and timeout classes are only used by some events, whose
+    // state is then kept in the cold part of the node
+    fd_cold *cold = fd_node->cold;
+
+    if (cold && cold->tmo_idx[event_type] != TMO_NONE) {
+        tmo_entry *ent = tmo_at(iosvc, cold->tmo_idx[event_type]);
+
+        if (ent->remaining)
+            *ent->remaining = ent->deadline > now ?
+                (int)(ent->deadline - now) :
+                0;
+
+        tmo_remove(iosvc, cold->tmo_idx[event_type]);
+        cold->tmo_idx[event_type] = TMO_NONE;
+    }
+
+    if (cold && cold->op_slot[event_type] != OPSLOT_NONE) {
+        opslot_free(iosvc, cold->op_slot[event_type]);
+        cold->op_slot[event_type] = OPSLOT_NONE;
+    }
 
-    if (!fd_node->main_event.handler.callback &&
-        !(fd_node->aux_event && fd_node->aux_event->handler.callback))
-        fd_node->main_ev_type = EMPTY;
+    if (status_ptr)
+        *status_ptr = status;
 
     // Unset pollfd event flags
     struct pollfd *pollent =
@@ -62,28 +74,50 @@ io_handler iosvc_dequeue(io_service *iosvc, rb_node *fd_node,
     if ((pollent->events & (evt_masks[WAIT_READ] | evt_masks[WAIT_WRITE])) == 0)
         pollent->events &= ~POLLERR;
 
+    backend_update(iosvc, pollent);
+
+    // Registration lingers until swept, so that it is reused by a subsequent
+    // event on the same FD (e.g. the next chunk of a stream)
+    if (pollent->events == 0)
+        ioevt_link_idle(iosvc, fd_node);
+
     return hnd;
 }
 
 void ioevt_cleanup_evt(io_service *iosvc, rb_place place, rb_node *parent) {
     rb_node *to_remove = rb_extract(place, parent, &iosvc->async_handlers);
+
+    ioevt_unlink_idle(to_remove);
     
     size_t pollfd_idx = to_remove->pollfd_idx;
-    free(to_remove->aux_event);
-    free(to_remove->ex_event);
-    free(to_remove);
+    node_release(iosvc, to_remove);
 
     // If removed node's pollfd is not the last position in pollvec,
     // move last pollfd to current index, and update its node to reflect
     // the new index
 
     struct pollfd *pollvec = (struct pollfd *)iosvc->pollfds.data;
-    pollvec[pollfd_idx] = pollvec[iosvc->pollfds.nelems - 1];
+    rb_node **nodes = (rb_node **)iosvc->pollfd_nodes.data;
+    size_t last = dynarr_size(&iosvc->pollfds) - 1;
+
+    if (pollfd_idx < last) {
+        pollvec[pollfd_idx] = pollvec[last];
+        nodes[pollfd_idx] = nodes[last];
+        nodes[pollfd_idx]->pollfd_idx = pollfd_idx;
+    }
 
     dynarr_pop_back(&iosvc->pollfds);
+    dynarr_pop_back(&iosvc->pollfd_nodes);
+}
+
+void ioevt_sweep_idle(io_service *iosvc) {
+    // Only lingering nodes are visited, as they are kept in a list of their
+    // own. Cleaning up a node unlinks it
+    while (iosvc->idle_nodes) {
+        rb_node *parent;
+        rb_place place = rb_ref_to_this(iosvc->idle_nodes,
+                                        &iosvc->async_handlers, &parent);
 
-    if (pollfd_idx < dynarr_size(&iosvc->pollfds)) {
-        place = rb_probe(&iosvc->async_handlers, &parent, pollvec[pollfd_idx].fd);
-        (*place)->pollfd_idx = pollfd_idx;
+        ioevt_cleanup_evt(iosvc, place, parent);
     }
 }
@@ -21,6 +21,51 @@ io_handler iosvc_dequeue(io_service *iosvc, rb_node *fd_node,
                          io_wait_type event_type, int64_t now,
                          io_errcode status);
 
+/**
+ * @brief Add a node left with no events to the lingering nodes
+ * 
+ * @param iosvc service holding the node
+ * @param node node to add
+ */
+inline static void ioevt_link_idle(io_service *iosvc, rb_node *node) {
+    if (node->idle_pprev)
+        return;
+
+    node->idle_next = iosvc->idle_nodes;
+    node->idle_pprev = &iosvc->idle_nodes;
+
+    if (node->idle_next)
+        node->idle_next->idle_pprev = &node->idle_next;
+
+    iosvc->idle_nodes = node;
+}
+
+/**
+ * @brief Remove a node from the lingering nodes, if listed
+ * 
+ * @param node node to remove
+ */
+inline static void ioevt_unlink_idle(rb_node *node) {
+    if (!node->idle_pprev)
+        return;
+
+    *node->idle_pprev = node->idle_next;
+
+    if (node->idle_next)
+        node->idle_next->idle_pprev = node->idle_pprev;
+
+    node->idle_pprev = NULL;
+}
+
+/**
+ * @brief Release all registrations left with no events (i.e. lingering).
+ * Done at the end of each loop iteration, before waiting for events, as
+ * lingering FDs may be closed by then
+ * 
+ * @param iosvc service to sweep
+ */
+void ioevt_sweep_idle(io_service *iosvc);
+
 /**
  * @brief Remove an event group node (each node contains all possible event
  * types for a single FD) from the events set and its associated
@@ -29,7 +74,7 @@ io_handler iosvc_dequeue(io_service *iosvc, rb_node *fd_node,
  * Removal of pollfd is done by moving the last pollfd in the poll vector to
  * the position held by the provided node.
  * 
- * Typically called when the associated pollfd's events is zero.
+ * Must only be called when the associated pollfd's events is zero.
  * 
  * @param iosvc service to remove the event group from
  * @param place place of node in set (tree)
@@ -0,0 +1,158 @@
+#include "iosvc_fdopt.h"
+
+#include <memory.h>
+
+#include "iosvc_cork.h"
+
+/**
+ * @brief Binary search the position of an FD in the sorted settings array
+ * 
+ * @param opts settings array (of `fd_opt *`, sorted by FD)
+ * @param fd file descriptor to search for
+ * @return Index of the first entry whose FD is not lower than `fd`
+ */
+static size_t lower_bound(dynarray *opts, int fd) {
+    fd_opt **vec = (fd_opt **)dynarr_front(opts);
+    size_t lo = 0, hi = dynarr_size(opts);
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (vec[mid]->fd < fd)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+fd_opt *fdopt_find(io_service *iosvc, int fd) {
+    dynarray *opts = &iosvc->fd_opts;
+
+    if (dynarr_empty(opts))
+        return NULL;
+
+    size_t idx = lower_bound(opts, fd);
+
+    if (idx == dynarr_size(opts))
+        return NULL;
+
+    fd_opt *opt = *(fd_opt **)dynarr_at(opts, idx);
+    return opt->fd == fd ? opt : NULL;
+}
+
+fd_opt *fdopt_lower_bound(io_service *iosvc, int fd) {
+    dynarray *opts = &iosvc->fd_opts;
+    size_t idx = lower_bound(opts, fd);
+
+    return idx < dynarr_size(opts) ? *(fd_opt **)dynarr_at(opts, idx) : NULL;
+}
+
+fd_opt *fdopt_get(io_service *iosvc, int fd) {
+    dynarray *opts = &iosvc->fd_opts;
+    size_t idx = lower_bound(opts, fd);
+
+    if (idx < dynarr_size(opts)) {
+        fd_opt *opt = *(fd_opt **)dynarr_at(opts, idx);
+        if (opt->fd == fd)
+            return opt;
+    }
+
+    fd_opt *opt = (fd_opt *)iomem_alloc(&iosvc->allocator, sizeof(*opt),
+                                         _Alignof(fd_opt));
+    if (!opt)
+        return NULL;
+
+    if (!dynarr_emplace_back(opts)) {
+        iomem_free(&iosvc->allocator, opt, sizeof(*opt));
+        return NULL;
+    }
+
+    *opt = (fd_opt){
+        .iosvc = iosvc,
+        .fd = fd,
+        .flags = 0,
+        .priority = IO_PRIO_NORMAL,
+        .wait_status = EIO_OK,
+    };
+    cbuf_init(&opt->cork_queue, sizeof(cork_write), &iosvc->allocator);
+
+    // Shift greater FDs one position to the right to keep the array sorted
+    fd_opt **pos = (fd_opt **)dynarr_at(opts, idx);
+    memmove(pos + 1, pos, (dynarr_size(opts) - 1 - idx) * sizeof(*pos));
+    *pos = opt;
+
+    return opt;
+}
+
+void fdopt_release(io_service *iosvc, fd_opt *opt) {
+    if (opt->flags || opt->priority != IO_PRIO_NORMAL ||
+        !cbuf_empty(&opt->cork_queue) || opt->cork_queued ||
+        opt->cork_waiting || opt->cork_busy)
+        return;
+
+    dynarray *opts = &iosvc->fd_opts;
+    size_t idx = lower_bound(opts, opt->fd);
+    fd_opt **pos = (fd_opt **)dynarr_at(opts, idx);
+
+    memmove(pos, pos + 1, (dynarr_size(opts) - 1 - idx) * sizeof(*pos));
+    dynarr_pop_back(opts);
+
+    cbuf_delete(&opt->cork_queue);
+    iomem_free(&iosvc->allocator, opt, sizeof(*opt));
+}
+
+void fdopt_delete_all(io_service *iosvc) {
+    fd_opt **vec = (fd_opt **)dynarr_front(&iosvc->fd_opts);
+
+    for (size_t i = 0; i < dynarr_size(&iosvc->fd_opts); ++i) {
+        cbuf_delete(&vec[i]->cork_queue);
+        iomem_free(&iosvc->allocator, vec[i], sizeof(*vec[i]));
+    }
+
+    dynarr_clear(&iosvc->fd_opts);
+    iosvc->prio_fds = 0;
+}
+
+io_errcode iosvc_set_fd_priority(io_service *iosvc, int fd,
+                                 io_priority prio) {
+    if ((unsigned)prio >= IO_PRIO_COUNT)
+        return EIO_INVARG;
+
+    fd_opt *opt = prio == IO_PRIO_NORMAL ? fdopt_find(iosvc, fd) :
+                                           fdopt_get(iosvc, fd);
+
+    if (!opt)
+        return prio == IO_PRIO_NORMAL ? EIO_OK : EIO_NOMEM;
+
+    if (opt->priority == IO_PRIO_NORMAL && prio != IO_PRIO_NORMAL)
+        ++iosvc->prio_fds;
+    else if (opt->priority != IO_PRIO_NORMAL && prio == IO_PRIO_NORMAL)
+        --iosvc->prio_fds;
+
+    opt->priority = prio;
+    fdopt_release(iosvc, opt);
+
+    return EIO_OK;
+}
+
+io_errcode iosvc_set_listener(io_service *iosvc, int fd, int enable) {
+    if (!enable) {
+        fd_opt *opt = fdopt_find(iosvc, fd);
+
+        if (opt) {
+            opt->flags &= ~FDOPT_LISTENER;
+            fdopt_release(iosvc, opt);
+        }
+
+        return EIO_OK;
+    }
+
+    fd_opt *opt = fdopt_get(iosvc, fd);
+    if (!opt)
+        return EIO_NOMEM;
+
+    opt->flags |= FDOPT_LISTENER;
+    return EIO_OK;
+}
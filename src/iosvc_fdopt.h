@@ -0,0 +1,98 @@
+#ifndef IOSVC_FDOPT_H_
+#define IOSVC_FDOPT_H_ 1
+
+// Per-FD settings, which (unlike event nodes) outlive individual event
+// registrations
+
+#include "iosvc_def.h"
+
+#define FDOPT_AUTOCORK 1u
+#define FDOPT_LISTENER 2u // Closed to new events while draining
+
+typedef struct fd_opt {
+    io_service *iosvc;
+    int fd;
+    unsigned flags;
+    io_priority priority;
+
+    // Auto-cork state. Pending writes are kept in issue order
+    cbuffer cork_queue;
+    io_errcode wait_status;
+    int cork_queued;  // FD is present in the service's `corked_fds`
+    int cork_waiting; // A `WAIT_WRITE` is scheduled to resume flushing
+    int cork_busy;    // A flush is in progress for this FD
+} fd_opt;
+
+/**
+ * @brief Find the settings of a file descriptor
+ * 
+ * @param iosvc service holding the settings
+ * @param fd file descriptor to query
+ * @return Settings for `fd`, or `NULL` if none are stored
+ */
+fd_opt *fdopt_find(io_service *iosvc, int fd);
+
+/**
+ * @brief Find the settings of a file descriptor, creating default ones if
+ * none are stored
+ * 
+ * @param iosvc service holding the settings
+ * @param fd file descriptor to query
+ * @return Settings for `fd`, or `NULL` if out of memory
+ */
+fd_opt *fdopt_get(io_service *iosvc, int fd);
+
+/**
+ * @brief Find the settings of the lowest file descriptor not lower than `fd`.
+ * Used to walk the settings while handlers may add or remove some
+ * 
+ * @param iosvc service holding the settings
+ * @param fd file descriptor to start from
+ * @return Settings found, or `NULL` if there are none
+ */
+fd_opt *fdopt_lower_bound(io_service *iosvc, int fd);
+
+/**
+ * @brief Remove the settings of a file descriptor if they hold no flags and
+ * no pending state anymore
+ * 
+ * @param iosvc service holding the settings
+ * @param opt settings to check for removal
+ */
+void fdopt_release(io_service *iosvc, fd_opt *opt);
+
+/**
+ * @brief Get the priority of a file descriptor
+ * 
+ * @param iosvc service holding the settings
+ * @param fd file descriptor to query
+ * @return Priority of `fd`
+ */
+inline static io_priority fdopt_priority(io_service *iosvc, int fd) {
+    if (!iosvc->prio_fds)
+        return IO_PRIO_NORMAL;
+
+    fd_opt *opt = fdopt_find(iosvc, fd);
+    return opt ? opt->priority : IO_PRIO_NORMAL;
+}
+
+/**
+ * @brief Check if a file descriptor is flagged as a listener
+ * 
+ * @param iosvc service holding the settings
+ * @param fd file descriptor to query
+ * @return nonzero if `fd` is a listener
+ */
+inline static int fdopt_is_listener(io_service *iosvc, int fd) {
+    fd_opt *opt = fdopt_find(iosvc, fd);
+    return opt && (opt->flags & FDOPT_LISTENER);
+}
+
+/**
+ * @brief Free all stored settings, without calling any pending handlers
+ * 
+ * @param iosvc service holding the settings
+ */
+void fdopt_delete_all(io_service *iosvc);
+
+#endif // IOSVC_FDOPT_H_
@@ -0,0 +1,106 @@
+#include "iosvc_hooks.h"
+
+#include <memory.h>
+
+/**
+ * @brief Drop the hooks removed while their kind was being run
+ * 
+ * @param hooks hooks of a kind
+ */
+static void compact_hooks(dynarray *hooks) {
+    io_handler *vec = (io_handler *)dynarr_front(hooks);
+    size_t kept = 0;
+
+    for (size_t i = 0; i < dynarr_size(hooks); ++i) {
+        if (vec[i].callback)
+            vec[kept++] = vec[i];
+    }
+
+    while (dynarr_size(hooks) > kept)
+        dynarr_pop_back(hooks);
+}
+
+void hooks_run(io_service *iosvc, int kind) {
+    dynarray *hooks = &iosvc->loop_hooks[kind];
+    int prev_running = iosvc->running_hooks;
+
+    // Hooks added meanwhile are first called on the next run. Removed ones
+    // are only unset until the run ends, so that indices stay valid. The
+    // array is not cached, as hooks may reallocate it
+    size_t count = dynarr_size(hooks);
+    iosvc->running_hooks = kind;
+
+    for (size_t i = 0; i < count; ++i) {
+        io_handler hnd = *(io_handler *)dynarr_at(hooks, i);
+
+        if (hnd.callback)
+            hnd.callback(hnd.ctx);
+    }
+
+    iosvc->running_hooks = prev_running;
+
+    if (prev_running != kind)
+        compact_hooks(hooks);
+}
+
+/**
+ * @brief Add a hook of a kind
+ * 
+ * @param iosvc service to add the hook to
+ * @param kind kind of the hook
+ * @param hnd hook to add
+ * @return Same as `iosvc_add_prepare_hook()`
+ */
+static io_errcode add_hook(io_service *iosvc, int kind, io_handler hnd) {
+    if (!hnd.callback)
+        return EIO_INVARG;
+
+    io_handler *pos = dynarr_emplace_back(&iosvc->loop_hooks[kind]);
+
+    if (!pos)
+        return EIO_NOMEM;
+
+    *pos = hnd;
+    return EIO_OK;
+}
+
+io_errcode iosvc_add_prepare_hook(io_service *iosvc, io_handler hnd) {
+    return add_hook(iosvc, HOOK_PREPARE, hnd);
+}
+
+io_errcode iosvc_add_check_hook(io_service *iosvc, io_handler hnd) {
+    return add_hook(iosvc, HOOK_CHECK, hnd);
+}
+
+io_errcode iosvc_add_idle_hook(io_service *iosvc, io_handler hnd) {
+    return add_hook(iosvc, HOOK_IDLE, hnd);
+}
+
+io_errcode iosvc_remove_hook(io_service *iosvc, io_handler hnd) {
+    io_errcode retval = EIO_NOENTRY;
+
+    for (int kind = 0; kind < IO_HOOK_COUNT; ++kind) {
+        dynarray *hooks = &iosvc->loop_hooks[kind];
+        io_handler *vec = (io_handler *)dynarr_front(hooks);
+
+        for (size_t i = 0; i < dynarr_size(hooks); ++i) {
+            if (!vec[i].callback || vec[i].callback != hnd.callback ||
+                vec[i].ctx != hnd.ctx)
+                continue;
+
+            // Hooks being run keep their place until the run ends
+            if (kind == iosvc->running_hooks) {
+                vec[i].callback = NULL;
+            } else {
+                memmove(&vec[i], &vec[i + 1],
+                        (dynarr_size(hooks) - 1 - i) * sizeof(*vec));
+                dynarr_pop_back(hooks);
+            }
+
+            retval = EIO_OK;
+            break;
+        }
+    }
+
+    return retval;
+}
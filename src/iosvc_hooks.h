@@ -0,0 +1,35 @@
+#ifndef IOSVC_HOOKS_H_
+#define IOSVC_HOOKS_H_ 1
+
+// Loop hooks, called once per iteration of the event loop at fixed points,
+// so that applications can batch work per iteration rather than per event
+
+#include "iosvc_def.h"
+
+// Kinds of hooks, indexing the service's `loop_hooks`
+enum {
+    HOOK_PREPARE,
+    HOOK_CHECK,
+    HOOK_IDLE
+};
+
+/**
+ * @brief Call all hooks of a kind, in the order they were added
+ * 
+ * @param iosvc service whose hooks to call
+ * @param kind kind of the hooks
+ */
+void hooks_run(io_service *iosvc, int kind);
+
+/**
+ * @brief Check if any hook of a kind was added
+ * 
+ * @param iosvc service to check
+ * @param kind kind of the hooks
+ * @return nonzero if hooks of `kind` are present
+ */
+inline static int hooks_present(io_service *iosvc, int kind) {
+    return !dynarr_empty(&iosvc->loop_hooks[kind]);
+}
+
+#endif // IOSVC_HOOKS_H_
@@ -0,0 +1,45 @@
+#include "iosvc_nodepool.h"
+
+int nodepool_init(io_service *iosvc, size_t count) {
+    if (!count)
+        return 0;
+
+    rb_node *nodes = (rb_node *)iomem_alloc(
+        &iosvc->allocator, count * sizeof(*nodes), RBNODE_ALIGN);
+    fd_cold *colds = (fd_cold *)iomem_alloc(
+        &iosvc->allocator, count * sizeof(*colds), _Alignof(fd_cold));
+
+    if (!nodes || !colds) {
+        iomem_free(&iosvc->allocator, nodes, count * sizeof(*nodes));
+        iomem_free(&iosvc->allocator, colds, count * sizeof(*colds));
+        return -1;
+    }
+
+    // Link in index order, so that nodes are first taken from the start of
+    // the pool
+    for (size_t i = 0; i < count; ++i) {
+        nodes[i].cold = &colds[i];
+        nodes[i].left = (i + 1 < count) ? &nodes[i + 1] : NULL;
+    }
+
+    iosvc->node_pool = nodes;
+    iosvc->cold_pool = colds;
+    iosvc->pool_size = count;
+    iosvc->free_nodes = nodes;
+
+    return 0;
+}
+
+void nodepool_delete(io_service *iosvc) {
+    size_t count = iosvc->pool_size;
+
+    iomem_free(&iosvc->allocator, iosvc->node_pool,
+               count * sizeof(*iosvc->node_pool));
+    iomem_free(&iosvc->allocator, iosvc->cold_pool,
+               count * sizeof(*iosvc->cold_pool));
+
+    iosvc->node_pool = NULL;
+    iosvc->cold_pool = NULL;
+    iosvc->pool_size = 0;
+    iosvc->free_nodes = NULL;
+}
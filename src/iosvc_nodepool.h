@@ -0,0 +1,62 @@
+#ifndef IOSVC_NODEPOOL_H_
+#define IOSVC_NODEPOOL_H_ 1
+
+// Event nodes of a service. Services with fixed capacity (see
+// `iosvc_create_fixed()`) take them from a pool preallocated at creation,
+// others from their allocator.
+
+#include "iosvc_def.h"
+
+/**
+ * @brief Preallocate the node pool of a service
+ * 
+ * @param iosvc service with fixed capacity
+ * @param count number of nodes (i.e. of FDs with registered events)
+ * @return 0 on success, -1 if no memory could be allocated
+ */
+int nodepool_init(io_service *iosvc, size_t count);
+
+/**
+ * @brief Release the node pool of a service, along with all nodes in use
+ * 
+ * @param iosvc service to release the pool of
+ */
+void nodepool_delete(io_service *iosvc);
+
+/**
+ * @brief Get a new, red node for a file descriptor
+ * 
+ * @return The node, or `NULL` if out of memory or if the pool is exhausted
+ */
+inline static rb_node *node_acquire(io_service *iosvc, int fd) {
+    if (!iosvc->fixed_capacity)
+        return make_rbnode(&iosvc->allocator, fd);
+
+    rb_node *node = iosvc->free_nodes;
+    if (!node)
+        return NULL;
+
+    iosvc->free_nodes = node->left;
+
+    fd_cold *cold = node->cold;
+    init_cold(cold);
+
+    memset(node, 0, sizeof(*node));
+    node->fd = fd;
+    node->meta = 1UL; // Set as red
+    node->cold = cold;
+
+    return node;
+}
+
+inline static void node_release(io_service *iosvc, rb_node *node) {
+    if (!iosvc->fixed_capacity) {
+        free_rbnode(&iosvc->allocator, node);
+        return;
+    }
+
+    node->left = iosvc->free_nodes;
+    iosvc->free_nodes = node;
+}
+
+#endif // IOSVC_NODEPOOL_H_
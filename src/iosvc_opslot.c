@@ -0,0 +1,48 @@
+#include "iosvc_opslot.h"
+
+uint32_t opslot_alloc(io_service *iosvc, io_op_handle *out_handle) {
+    uint32_t idx = iosvc->free_op_slot;
+
+    if (idx == OPSLOT_NONE) {
+        // Keep the last index free, as it is used as a sentinel
+        if (dynarr_size(&iosvc->op_slots) >= OPSLOT_NONE)
+            return OPSLOT_NONE;
+
+        op_slot *slot = (op_slot *)dynarr_emplace_back(&iosvc->op_slots);
+        if (!slot)
+            return OPSLOT_NONE;
+
+        slot->gen = 0;
+        idx = (uint32_t)(dynarr_size(&iosvc->op_slots) - 1);
+    } else {
+        iosvc->free_op_slot = opslot_at(iosvc, idx)->next_free;
+    }
+
+    op_slot *slot = opslot_at(iosvc, idx);
+
+    ++slot->gen;
+    slot->next_free = OPSLOT_NONE;
+    slot->cancelled = 0;
+
+    *out_handle = (io_op_handle){.idx = idx, .gen = slot->gen};
+    return idx;
+}
+
+void opslot_free(io_service *iosvc, uint32_t idx) {
+    op_slot *slot = opslot_at(iosvc, idx);
+
+    // Cancelled slots were already invalidated
+    if (slot->gen & 1u)
+        ++slot->gen;
+
+    slot->next_free = iosvc->free_op_slot;
+    iosvc->free_op_slot = idx;
+}
+
+op_slot *opslot_get(io_service *iosvc, io_op_handle handle) {
+    if (handle.idx >= dynarr_size(&iosvc->op_slots) || !(handle.gen & 1u))
+        return NULL;
+
+    op_slot *slot = opslot_at(iosvc, handle.idx);
+    return slot->gen == handle.gen ? slot : NULL;
+}
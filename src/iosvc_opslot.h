@@ -0,0 +1,76 @@
+#ifndef IOSVC_OPSLOT_H_
+#define IOSVC_OPSLOT_H_ 1
+
+// Slots backing `io_op_handle`s. A handle is an index in the service's slot
+// table, paired with the slot's generation at the moment it was handed out.
+// Generations are odd while the slot is in use, so releasing a slot (which
+// increments its generation) invalidates all handles referring to it.
+
+#include <stdint.h>
+
+#include "iosvc_def.h"
+
+#define OPSLOT_NONE UINT32_MAX
+
+typedef struct op_slot {
+    uint32_t gen;
+    uint32_t next_free;
+
+    enum {
+        OP_EVENT,
+        OP_DELAY,
+        OP_CLASS_DELAY
+    } kind;
+
+    // Cancelled delayed handlers stay in the timers heap until they expire
+    int cancelled;
+
+    union {
+        // Event location, for `OP_EVENT`
+        struct {
+            rb_node *node;
+            io_wait_type wait_type;
+        };
+
+        // Handler to cancel, for `OP_DELAY`
+        struct {
+            io_handler hnd;
+            io_errcode *status;
+        };
+
+        // Timeout class entry, for `OP_CLASS_DELAY`
+        uint32_t tmo_idx;
+    };
+} op_slot;
+
+/**
+ * @brief Allocate a slot and produce a handle for it
+ * 
+ * @param iosvc service to allocate the slot in
+ * @param out_handle out parameter; handle referring to the allocated slot
+ * @return Index of the allocated slot, or `OPSLOT_NONE` if out of memory
+ */
+uint32_t opslot_alloc(io_service *iosvc, io_op_handle *out_handle);
+
+/**
+ * @brief Release a slot, invalidating all handles referring to it
+ * 
+ * @param iosvc service holding the slot
+ * @param idx index of slot to release
+ */
+void opslot_free(io_service *iosvc, uint32_t idx);
+
+/**
+ * @brief Get the slot referred to by a handle
+ * 
+ * @param iosvc service holding the slot
+ * @param handle handle to resolve
+ * @return The slot, or `NULL` if the handle is stale or invalid
+ */
+op_slot *opslot_get(io_service *iosvc, io_op_handle handle);
+
+inline static op_slot *opslot_at(io_service *iosvc, uint32_t idx) {
+    return (op_slot *)dynarr_at(&iosvc->op_slots, idx);
+}
+
+#endif // IOSVC_OPSLOT_H_
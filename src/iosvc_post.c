@@ -4,15 +4,22 @@
 
 #include "heaputils.h"
 #include "delay_heap_entry.h"
+#include "iosvc_opslot.h"
+#include "iosvc_tmoclass.h"
 
 io_errcode iosvc_post(io_service *iosvc, io_handler hnd) {
+    return iosvc_post_prio(iosvc, hnd, IO_PRIO_NORMAL);
+}
+
+io_errcode iosvc_post_prio(io_service *iosvc, io_handler hnd,
+                           io_priority prio) {
     if (iosvc->status != RUNNING && iosvc->status != READY)
         return EIO_STOPPED;
 
-    if (!hnd.callback)
+    if (!hnd.callback || (unsigned)prio >= IO_PRIO_COUNT)
         return EIO_INVARG;
 
-    io_handler *pos = cbuf_push(&iosvc->sync_handlers);
+    io_handler *pos = cbuf_push(&iosvc->sync_handlers[prio]);
 
     if (!pos)
         return EIO_NOMEM;
@@ -21,30 +28,148 @@ io_errcode iosvc_post(io_service *iosvc, io_handler hnd) {
     return EIO_OK;
 }
 
+/**
+ * @brief Push a handler in the delayed handlers heap
+ * 
+ * @param iosvc service to schedule the handler on
+ * @param hnd handler to schedule
+ * @param status completion status signalled by the service
+ * @param deadline time to call the handler at
+ * @param period period of the handler, or 0 if called only once
+ * @param slack how late the handler may be called (in milliseconds)
+ * @param op out parameter; handle to the handler. No handle is produced if
+ * `NULL`
+ * @return Same as `iosvc_post_delay()`
+ */
+static io_errcode push_timed(io_service *iosvc, io_handler hnd,
+                             io_errcode *status, int64_t deadline,
+                             int64_t period, int slack, io_op_handle *op)
+{
+    if (iosvc->status == STOPPING || iosvc->status == DONE)
+        return EIO_STOPPED;
+
+    uint32_t slot_idx = OPSLOT_NONE;
+
+    if (op) {
+        if ((slot_idx = opslot_alloc(iosvc, op)) == OPSLOT_NONE)
+            return EIO_NOMEM;
+
+        op_slot *slot = opslot_at(iosvc, slot_idx);
+
+        slot->kind = OP_DELAY;
+        slot->hnd = hnd;
+        slot->status = status;
+    }
+
+    delay_heap_entry ent = {
+        .handler = hnd,
+        .status = status,
+        .due = deadline,
+        .slack = slack,
+        .period = period,
+        .op_slot = slot_idx
+    };
+
+    if (delay_heap_push(&iosvc->timed_handlers_heap,
+                        apply_slack(deadline, slack), &ent) < 0) {
+        if (slot_idx != OPSLOT_NONE)
+            opslot_free(iosvc, slot_idx);
+
+        return EIO_NOMEM;
+    }
+
+    return EIO_OK;
+}
+
 io_errcode iosvc_post_delay(io_service *iosvc, io_handler hnd,
                             io_errcode *status, int milliseconds)
 {
-    int64_t deadline = current_time() + milliseconds;
+    return iosvc_post_delay_op(iosvc, hnd, status, milliseconds, NULL);
+}
+
+io_errcode iosvc_post_delay_op(io_service *iosvc, io_handler hnd,
+                               io_errcode *status, int milliseconds,
+                               io_op_handle *op)
+{
+    return iosvc_post_delay_slack(iosvc, hnd, status, milliseconds, 0, op);
+}
+
+io_errcode iosvc_post_delay_slack(io_service *iosvc, io_handler hnd,
+                                  io_errcode *status, int milliseconds,
+                                  int slack, io_op_handle *op)
+{
+    if (!hnd.callback || milliseconds < 0 || slack < 0)
+        return EIO_INVARG;
+
+    return push_timed(iosvc, hnd, status, current_time() + milliseconds, 0,
+                      slack, op);
+}
 
-    if (!hnd.callback || milliseconds < 0)
+io_errcode iosvc_post_at(io_service *iosvc, io_handler hnd,
+                         io_errcode *status, int64_t deadline,
+                         io_op_handle *op)
+{
+    if (!hnd.callback || deadline < 0)
         return EIO_INVARG;
 
+    return push_timed(iosvc, hnd, status, deadline, 0, 0, op);
+}
+
+io_errcode iosvc_post_periodic(io_service *iosvc, io_handler hnd,
+                               io_errcode *status, int interval,
+                               io_op_handle *op)
+{
+    return iosvc_post_periodic_slack(iosvc, hnd, status, interval, 0, op);
+}
+
+io_errcode iosvc_post_periodic_slack(io_service *iosvc, io_handler hnd,
+                                     io_errcode *status, int interval,
+                                     int slack, io_op_handle *op)
+{
+    if (!hnd.callback || interval <= 0 || slack < 0)
+        return EIO_INVARG;
+
+    return push_timed(iosvc, hnd, status, current_time() + interval,
+                      interval, slack, op);
+}
+
+io_errcode iosvc_post_class_delay(io_service *iosvc, io_handler hnd,
+                                  io_errcode *status, int class_id,
+                                  io_op_handle *op)
+{
     if (iosvc->status == STOPPING || iosvc->status == DONE)
         return EIO_STOPPED;
 
-    delay_heap_entry *ent = dynarr_emplace_back(&iosvc->timed_handlers_heap);
+    if (!hnd.callback || !tmo_valid_class(iosvc, class_id))
+        return EIO_INVARG;
+
+    uint32_t slot_idx = OPSLOT_NONE;
 
-    if (!ent)
+    if (op && (slot_idx = opslot_alloc(iosvc, op)) == OPSLOT_NONE)
         return EIO_NOMEM;
 
-    *ent = (delay_heap_entry){
-        .handler = hnd,
-        .status = status,
-        .deadline = deadline
-    };
+    uint32_t tmo_idx = tmo_arm(iosvc, (uint32_t)class_id);
+
+    if (tmo_idx == TMO_NONE) {
+        if (slot_idx != OPSLOT_NONE)
+            opslot_free(iosvc, slot_idx);
+
+        return EIO_NOMEM;
+    }
+
+    tmo_entry *ent = tmo_at(iosvc, tmo_idx);
+
+    ent->is_event = 0;
+    ent->hnd = hnd;
+    ent->status = status;
+    ent->op_slot = slot_idx;
+
+    if (slot_idx != OPSLOT_NONE) {
+        op_slot *slot = opslot_at(iosvc, slot_idx);
 
-    heap_sift_up(&iosvc->timed_handlers_heap, ent,
-                 delay_hp_ent_lt, delay_hp_ent_swp);
+        slot->kind = OP_CLASS_DELAY;
+        slot->tmo_idx = tmo_idx;
+    }
 
     return EIO_OK;
 }
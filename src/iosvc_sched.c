@@ -7,124 +7,68 @@
 #include "async_heap_entry.h"
 
 #include "rbtree.h"
+#include "iosvc_opslot.h"
+#include "iosvc_tmoclass.h"
+#include "iosvc_backend.h"
+#include "iosvc_nodepool.h"
+#include "iosvc_fdopt.h"
+#include "iosvc_dequeue.h"
 
 #define READ_MASK   (POLLRDNORM | POLLRDBAND | POLLERR | POLLHUP | POLLIN)
 #define WRITE_MASK  (POLLWRNORM | POLLWRBAND | POLLERR | POLLOUT)
 #define EXCEPT_MASK (POLLPRI)
 
 /**
- * @brief Check if an event is scheduled in the given node
- * 
- * @param node node to query for event presence
- * @param event event to check
- * @return 0 if not found, nonzero if present
- */
-inline static int is_scheduled(rb_node *node, io_event event) {
-    if (event.wait_type == WAIT_EXCEPTION)
-        return node->ex_event && node->ex_event->handler.callback;
-
-    if (node->main_ev_type == EMPTY)
-        return 0;
-
-    // Check if requested event is scheduled as main event
-    if ((event.wait_type == WAIT_READ && node->main_ev_type == READ) ||
-        (event.wait_type == WAIT_WRITE && node->main_ev_type == WRITE)) {
-        return node->main_event.handler.callback != NULL;
-    } else {
-        return node->aux_event && node->aux_event->handler.callback;
-    }
-}
-
-/**
- * @brief Reserve memory for an event in the current node
- * 
- * @param node node to reserve memory in
- * @param requested `WAIT_READ` or `WAIT_WRITE`
- * @return `NULL` if no memory could be allocated, non-null pointer
- * to reserved memory if successful
- */
-inline static event_data *reserve_rd_wr(rb_node *node, io_wait_type requested) {
-    // Check if no R/W event is stored, if so, use inline storage
-    if (node->main_ev_type == EMPTY) {
-        node->main_ev_type = requested == WAIT_READ ? READ : WRITE;
-
-        return &node->main_event;
-    }
-
-    io_wait_type stored = node->main_ev_type == READ ? WAIT_READ : WAIT_WRITE;
-
-    if (stored == requested)
-        return &node->main_event;
-
-    // stored != requested, first check if there is allocated space that
-    // can be reused, else check if exception is not in use and can be stolen
-    if (!node->aux_event) {
-        if (node->ex_event && !node->ex_event->handler.callback) {
-            node->aux_event = node->ex_event;
-            node->ex_event = NULL;
-        } else {
-            node->aux_event = (event_data *)malloc(sizeof(*node->aux_event));
-        }
-    }
-
-    return node->aux_event;
-}
-/**
- * @brief Reserve and allocate memory for event data (optionally a node too if
- * provided event's FD has no node)
+ * @brief Reserve memory for an event in the node of its FD, allocating the
+ * node too if the FD has none
  * 
+ * @param iosvc service owning the node
  * @param place place of node in set
  * @param parent parent of node in set
  * @param root_ref reference to root of set
  * @param event requested event
+ * @param need_cold whether the event needs the cold state of the node
+ * @param out_node out parameter; node holding the reserved event data
  * @return A valid, in place pointer for success, or NULL if out of mem 
  */
-inline static event_data *reserve_evt_mem(rb_place place, rb_node *parent,
-                                          rb_node **root_ref, io_event event) {
+inline static event_data *reserve_evt_mem(io_service *iosvc, rb_place place,
+                                          rb_node *parent, rb_node **root_ref,
+                                          io_event event, int need_cold,
+                                          rb_node **out_node) {
     int is_new_node = (*place == NULL);
     rb_node *new_node;
 
     // Allocate node if needed
     if (is_new_node) {
-        if ((new_node = make_rbnode(event.fd)) == NULL)
+        if ((new_node = node_acquire(iosvc, event.fd)) == NULL)
             return NULL;
     } else {
         new_node = *place;
     }
 
-    event_data *retval;
-    if (event.wait_type == WAIT_EXCEPTION) {
-        if (!new_node->ex_event) {
-            // No storage for exception, check if aux is allocated and not in
-            // use and steal its memory
-            if (new_node->aux_event && !new_node->aux_event->handler.callback) {
-                new_node->ex_event = new_node->aux_event;
-                new_node->aux_event = NULL;
-            } else {
-                new_node->ex_event = (event_data *)malloc(sizeof(*retval));
-            }
-        }
+    // Read and write events are stored inline in the node, exception
+    // events in its cold state
+    event_data *retval = NULL;
 
-        retval = new_node->ex_event;
-    } else {
-        retval = reserve_rd_wr(new_node, event.wait_type);
-    }
+    if (!need_cold || get_cold(&iosvc->allocator, new_node))
+        retval = get_evt_data(new_node, event.wait_type);
 
     if (is_new_node) {
-        if (retval) {
+        // Insertion may rotate the tree, so `place` is not guaranteed to
+        // refer to the new node afterwards
+        if (retval)
             rb_insert(new_node, place, parent, root_ref);
-            *place = new_node;
-        } else {
-            free(new_node);
-        }
+        else
+            node_release(iosvc, new_node);
     }
 
-    *place = new_node;
+    *out_node = new_node;
     return retval;
 }
 
 inline static io_errcode iosvc_enqueue(io_service *iosvc, io_event event,
                                        io_handler *phnd, io_errcode *status,
+                                       uint32_t slot_idx, uint32_t tmo_idx,
                                        rb_node **out_node) {
     if (iosvc->status != READY && iosvc->status != RUNNING)
         return EIO_STOPPED;
@@ -132,44 +76,63 @@ inline static io_errcode iosvc_enqueue(io_service *iosvc, io_event event,
     if (!phnd->callback || event.wait_type == 3u)
         return EIO_INVARG;
 
+    // Listeners take no new work while the service is draining
+    if (iosvc->draining && fdopt_is_listener(iosvc, event.fd))
+        return EIO_STOPPED;
+
     rb_node *parent = NULL;
     rb_place place = rb_probe(&iosvc->async_handlers, &parent, event.fd);
     int is_new_node = (*place == NULL);
 
     if (!is_new_node) {
-        if (is_scheduled(*place, event))
+        if (is_pending(*place, event.wait_type))
             return EIO_INPROGRESS;
     } else {
         if (dynarr_emplace_back(&iosvc->pollfds) == NULL)
             return EIO_NOMEM;
+
+        if (dynarr_emplace_back(&iosvc->pollfd_nodes) == NULL) {
+            dynarr_pop_back(&iosvc->pollfds);
+            return EIO_NOMEM;
+        }
     }
 
-    // Check for vacated storage (by previous dequeue if any), or allocate
-    // memory for requested event if no vacant storage is found
-    // (optionally allocate node too if required)
-    event_data *data =
-        reserve_evt_mem(place, parent, &iosvc->async_handlers, event);
+    int need_cold = event.wait_type == WAIT_EXCEPTION ||
+                    slot_idx != OPSLOT_NONE || tmo_idx != TMO_NONE;
+
+    // Vacated storage (by previous dequeue if any) is reused, memory is
+    // only allocated for new nodes and their cold state
+    event_data *data = reserve_evt_mem(iosvc, place, parent,
+                                       &iosvc->async_handlers, event,
+                                       need_cold, out_node);
 
     if (!data) {
         // Failed to allocate data for event
-        if (is_new_node)
+        if (is_new_node) {
             dynarr_pop_back(&iosvc->pollfds);
+            dynarr_pop_back(&iosvc->pollfd_nodes);
+        }
 
         return EIO_NOMEM;
     }
 
     *data = (event_data){
-        .ddl_heap_idx = -1,
         .handler = *phnd,
-        .status = status
+        .status = status,
+        .ddl_heap_idx = -1
     };
 
-    *out_node = *place;
+    if ((*out_node)->cold) {
+        (*out_node)->cold->op_slot[event.wait_type] = slot_idx;
+        (*out_node)->cold->tmo_idx[event.wait_type] = tmo_idx;
+    }
+
     struct pollfd *pollent_ptr = NULL;
 
     // Find pollfd entry in pollfds array, or create one if needed
     if (is_new_node) {
         (*out_node)->pollfd_idx = dynarr_size(&iosvc->pollfds) - 1;
+        *(rb_node **)dynarr_back(&iosvc->pollfd_nodes) = *out_node;
 
         pollent_ptr = (struct pollfd *)dynarr_back(&iosvc->pollfds);
         *pollent_ptr = (struct pollfd){
@@ -180,6 +143,10 @@ inline static io_errcode iosvc_enqueue(io_service *iosvc, io_event event,
     } else {
         pollent_ptr = (struct pollfd *)
                         dynarr_at(&iosvc->pollfds, (*out_node)->pollfd_idx);
+
+        // Registration was lingering, and is reused as is
+        if (pollent_ptr->events == 0)
+            ioevt_unlink_idle(*out_node);
     }
 
     static short const evt_masks[] = {
@@ -189,51 +156,211 @@ inline static io_errcode iosvc_enqueue(io_service *iosvc, io_event event,
     };
 
     pollent_ptr->events |= evt_masks[event.wait_type];
+    backend_update(iosvc, pollent_ptr);
 
     return EIO_OK;
 }
 
+/**
+ * @brief Enqueue an event, optionally producing a handle to it
+ * 
+ * @param iosvc service to enqueue the event on
+ * @param event event to enqueue
+ * @param phnd handler of the event
+ * @param status completion status of the event
+ * @param tmo_idx timeout class entry of the event, or `TMO_NONE`
+ * @param op out parameter; handle to the event. Nothing is produced if `NULL`
+ * @param out_node out parameter; node the event was stored in
+ * @return Same as `iosvc_sched()`
+ */
+inline static io_errcode iosvc_enqueue_op(io_service *iosvc, io_event event,
+                                          io_handler *phnd, io_errcode *status,
+                                          uint32_t tmo_idx, io_op_handle *op,
+                                          rb_node **out_node) {
+    uint32_t slot_idx = OPSLOT_NONE;
+
+    if (op && (slot_idx = opslot_alloc(iosvc, op)) == OPSLOT_NONE)
+        return EIO_NOMEM;
+
+    io_errcode ioerr = iosvc_enqueue(iosvc, event, phnd, status, slot_idx,
+                                     tmo_idx, out_node);
+
+    if (slot_idx != OPSLOT_NONE) {
+        if (ioerr) {
+            opslot_free(iosvc, slot_idx);
+        } else {
+            op_slot *slot = opslot_at(iosvc, slot_idx);
+
+            slot->kind = OP_EVENT;
+            slot->node = *out_node;
+            slot->wait_type = event.wait_type;
+        }
+    }
+
+    return ioerr;
+}
+
 io_errcode iosvc_sched(io_service *iosvc, io_event event, io_handler hnd,
                        io_errcode *status) {
+    return iosvc_sched_op(iosvc, event, hnd, status, NULL);
+}
+
+io_errcode iosvc_sched_op(io_service *iosvc, io_event event, io_handler hnd,
+                          io_errcode *status, io_op_handle *op) {
     rb_node *res_node;
-    io_errcode ioerr = iosvc_enqueue(iosvc, event, &hnd, status, &res_node);
-    (void)res_node;
+    return iosvc_enqueue_op(iosvc, event, &hnd, status, TMO_NONE, op,
+                            &res_node);
+}
+
+io_errcode iosvc_sched_many(io_service *iosvc, io_event const *events,
+                            io_handler const *hnds, io_errcode *statuses,
+                            size_t count, size_t *scheduled) {
+    size_t i = 0;
+    io_errcode ioerr = EIO_OK;
+
+    if (scheduled)
+        *scheduled = 0;
+
+    if (iosvc->status != READY && iosvc->status != RUNNING)
+        return EIO_STOPPED;
+
+    // Reserve pollfds for all events at once, as if all of them were
+    // scheduled on new FDs. Services with fixed capacity are already
+    // reserved for, and events are scheduled until it runs out
+    size_t capacity = dynarr_size(&iosvc->pollfds) + count;
+
+    if (!iosvc->fixed_capacity &&
+        (dynarr_reserve(&iosvc->pollfds, capacity) < 0 ||
+         dynarr_reserve(&iosvc->pollfd_nodes, capacity) < 0))
+        return EIO_NOMEM;
+
+    for (; i < count; ++i) {
+        io_handler hnd = hnds[i];
+        rb_node *res_node;
+
+        ioerr = iosvc_enqueue(iosvc, events[i], &hnd,
+                              statuses ? &statuses[i] : NULL, OPSLOT_NONE,
+                              TMO_NONE, &res_node);
+        if (ioerr)
+            break;
+    }
+
+    if (scheduled)
+        *scheduled = i;
 
     return ioerr;
 }
 
-
 io_errcode iosvc_sched_timeout(io_service *iosvc, io_event event,
                                io_handler hnd, io_errcode *status,
                                int *milliseconds)
 {
-    int64_t deadline = current_time() + *milliseconds;
+    return iosvc_sched_timeout_op(iosvc, event, hnd, status, milliseconds,
+                                  NULL);
+}
 
-    async_heap_entry *heap_ent =
-        (async_heap_entry *)dynarr_emplace_back(&iosvc->timed_events_heap);
+/**
+ * @brief Enqueue an event, and push its deadline in the timed events heap
+ * 
+ * @param iosvc service to enqueue the event on
+ * @param event event to enqueue
+ * @param phnd handler of the event
+ * @param status completion status of the event
+ * @param deadline absolute deadline of the event (slack already applied)
+ * @param remaining out parameter; remaining time when the handler is called.
+ * Not provided if `NULL`
+ * @param op out parameter; handle to the event. Nothing is produced if `NULL`
+ * @return Same as `iosvc_sched_timeout()`
+ */
+static io_errcode enqueue_timed(io_service *iosvc, io_event event,
+                                io_handler *phnd, io_errcode *status,
+                                int64_t deadline, int *remaining,
+                                io_op_handle *op)
+{
+    async_heap *heap = &iosvc->timed_events_heap;
 
-    if (!heap_ent)
+    // Reserve room first, so that pushing the deadline can not fail once the
+    // event is enqueued
+    if (async_heap_reserve_one(heap) < 0)
         return EIO_NOMEM;
 
     rb_node *res_node;
-    io_errcode ioerr = iosvc_enqueue(iosvc, event, &hnd, status, &res_node);
-    if (ioerr) {
-        dynarr_pop_back(&iosvc->timed_events_heap);
+    io_errcode ioerr = iosvc_enqueue_op(iosvc, event, phnd, status,
+                                        TMO_NONE, op, &res_node);
+    if (ioerr)
         return ioerr;
-    }
 
-    *heap_ent = (async_heap_entry){
-        .deadline = deadline,
+    async_heap_entry heap_ent = {
         .event_type = event.wait_type,
         .io_op_data = res_node,
-        .remaining = milliseconds
+        .remaining = remaining
     };
 
-    size_t heap_idx = dynarr_size(&iosvc->timed_events_heap) - 1;
-    get_evt_data(res_node, event.wait_type)->ddl_heap_idx = (ptrdiff_t)heap_idx;
+    // Sets the heap index of the event
+    async_heap_push(heap, deadline, &heap_ent);
+
+    return ioerr;
+}
+
+io_errcode iosvc_sched_timeout_op(io_service *iosvc, io_event event,
+                                  io_handler hnd, io_errcode *status,
+                                  int *milliseconds, io_op_handle *op)
+{
+    return iosvc_sched_timeout_slack(iosvc, event, hnd, status, milliseconds,
+                                     0, op);
+}
+
+io_errcode iosvc_sched_timeout_slack(io_service *iosvc, io_event event,
+                                     io_handler hnd, io_errcode *status,
+                                     int *milliseconds, int slack,
+                                     io_op_handle *op)
+{
+    if (slack < 0)
+        return EIO_INVARG;
+
+    int64_t deadline = apply_slack(current_time() + *milliseconds, slack);
+
+    return enqueue_timed(iosvc, event, &hnd, status, deadline, milliseconds,
+                         op);
+}
+
+io_errcode iosvc_sched_until(io_service *iosvc, io_event event,
+                             io_handler hnd, io_errcode *status,
+                             int64_t deadline, io_op_handle *op)
+{
+    if (deadline < 0)
+        return EIO_INVARG;
+
+    return enqueue_timed(iosvc, event, &hnd, status, deadline, NULL, op);
+}
+
+io_errcode iosvc_sched_class_timeout(io_service *iosvc, io_event event,
+                                     io_handler hnd, io_errcode *status,
+                                     int class_id, int *remaining,
+                                     io_op_handle *op)
+{
+    if (!tmo_valid_class(iosvc, class_id))
+        return EIO_INVARG;
+
+    uint32_t tmo_idx = tmo_arm(iosvc, (uint32_t)class_id);
+
+    if (tmo_idx == TMO_NONE)
+        return EIO_NOMEM;
+
+    rb_node *res_node;
+    io_errcode ioerr = iosvc_enqueue_op(iosvc, event, &hnd, status, tmo_idx,
+                                        op, &res_node);
+    if (ioerr) {
+        tmo_remove(iosvc, tmo_idx);
+        return ioerr;
+    }
+
+    tmo_entry *ent = tmo_at(iosvc, tmo_idx);
 
-    heap_sift_up_idx(&iosvc->timed_events_heap, heap_idx,
-                     async_hp_ent_lt, async_hp_ent_swp);
+    ent->is_event = 1;
+    ent->node = res_node;
+    ent->wait_type = event.wait_type;
+    ent->remaining = remaining;
 
     return ioerr;
 }
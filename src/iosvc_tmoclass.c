@@ -0,0 +1,93 @@
+#include "iosvc_tmoclass.h"
+
+#include "heaputils.h"
+
+io_errcode iosvc_add_timeout_class(io_service *iosvc, int milliseconds,
+                                   int slack, int *class_id) {
+    if (milliseconds < 0 || slack < 0 || !class_id)
+        return EIO_INVARG;
+
+    if (dynarr_size(&iosvc->tmo_classes) >= (size_t)INT32_MAX)
+        return EIO_NOMEM;
+
+    tmo_class *cls = (tmo_class *)dynarr_emplace_back(&iosvc->tmo_classes);
+    if (!cls)
+        return EIO_NOMEM;
+
+    *cls = (tmo_class){
+        .duration = milliseconds,
+        .slack = slack,
+        .head = TMO_NONE,
+        .tail = TMO_NONE
+    };
+
+    *class_id = (int)(dynarr_size(&iosvc->tmo_classes) - 1);
+    return EIO_OK;
+}
+
+uint32_t tmo_arm(io_service *iosvc, uint32_t cls) {
+    uint32_t idx = iosvc->free_tmo;
+
+    if (idx == TMO_NONE) {
+        // Keep the last index free, as it is used as a sentinel
+        if (dynarr_size(&iosvc->tmo_entries) >= TMO_NONE)
+            return TMO_NONE;
+
+        if (!dynarr_emplace_back(&iosvc->tmo_entries))
+            return TMO_NONE;
+
+        idx = (uint32_t)(dynarr_size(&iosvc->tmo_entries) - 1);
+    } else {
+        iosvc->free_tmo = tmo_at(iosvc, idx)->next;
+    }
+
+    tmo_class *tcls = tmo_class_at(iosvc, cls);
+    tmo_entry *ent = tmo_at(iosvc, idx);
+
+    // The slack of a class never changes, and rounding with a given slack is
+    // monotonic, so it preserves the FIFO order
+    ent->deadline = apply_slack(current_time() + tcls->duration, tcls->slack);
+    ent->cls = cls;
+    ent->prev = tcls->tail;
+    ent->next = TMO_NONE;
+
+    if (tcls->tail != TMO_NONE)
+        tmo_at(iosvc, tcls->tail)->next = idx;
+    else
+        tcls->head = idx;
+
+    tcls->tail = idx;
+    ++iosvc->armed_tmos;
+
+    return idx;
+}
+
+void tmo_remove(io_service *iosvc, uint32_t idx) {
+    tmo_entry *ent = tmo_at(iosvc, idx);
+    tmo_class *tcls = tmo_class_at(iosvc, ent->cls);
+
+    if (ent->prev != TMO_NONE)
+        tmo_at(iosvc, ent->prev)->next = ent->next;
+    else
+        tcls->head = ent->next;
+
+    if (ent->next != TMO_NONE)
+        tmo_at(iosvc, ent->next)->prev = ent->prev;
+    else
+        tcls->tail = ent->prev;
+
+    ent->next = iosvc->free_tmo;
+    iosvc->free_tmo = idx;
+    --iosvc->armed_tmos;
+}
+
+void tmo_clear(io_service *iosvc) {
+    tmo_class *classes = (tmo_class *)dynarr_front(&iosvc->tmo_classes);
+
+    for (size_t i = 0; i < dynarr_size(&iosvc->tmo_classes); ++i)
+        classes[i].head = classes[i].tail = TMO_NONE;
+
+    dynarr_clear(&iosvc->tmo_entries);
+    iosvc->free_tmo = TMO_NONE;
+    iosvc->armed_tmos = 0;
+}
@@ -0,0 +1,93 @@
+#ifndef IOSVC_TMOCLASS_H_
+#define IOSVC_TMOCLASS_H_ 1
+
+// Timeout classes. All timers of a class have the same duration, so they
+// expire in the order they were armed, and each class keeps them in a FIFO
+// list instead of a heap: arming appends to the tail, cancelling unlinks, and
+// only the heads of the lists are considered when computing the next
+// deadline. Entries live in a single table and are linked by index, so that
+// the table can be reallocated
+
+#include <stdint.h>
+
+#include "iosvc_def.h"
+
+#define TMO_NONE UINT32_MAX
+
+typedef struct tmo_class {
+    int duration;
+    int slack;
+    uint32_t head;
+    uint32_t tail;
+} tmo_class;
+
+typedef struct tmo_entry {
+    int64_t deadline;
+    uint32_t prev;
+    uint32_t next; // Next free entry, while not armed
+    uint32_t cls;
+    int is_event;
+
+    union {
+        // Timed out event
+        struct {
+            rb_node *node;
+            io_wait_type wait_type;
+            int *remaining; // May be NULL
+        };
+
+        // Delayed handler
+        struct {
+            io_handler hnd;
+            io_errcode *status;
+            uint32_t op_slot;
+        };
+    };
+} tmo_entry;
+
+/**
+ * @brief Arm a timer at the tail of a class' list
+ * 
+ * @param iosvc service to arm the timer on
+ * @param cls index of class (must be valid)
+ * @return Index of the armed entry, or `TMO_NONE` if out of memory. The entry
+ * only has its deadline and links set
+ */
+uint32_t tmo_arm(io_service *iosvc, uint32_t cls);
+
+/**
+ * @brief Unlink a timer from its class' list and release its entry
+ * 
+ * @param iosvc service holding the timer
+ * @param idx index of the entry to release
+ */
+void tmo_remove(io_service *iosvc, uint32_t idx);
+
+/**
+ * @brief Release all timers, leaving all classes empty
+ * 
+ * @param iosvc service holding the timers
+ */
+void tmo_clear(io_service *iosvc);
+
+/**
+ * @brief Check if a class ID refers to an existing class
+ * 
+ * @param iosvc service to look in
+ * @param class_id ID to check
+ * @return nonzero if valid
+ */
+inline static int tmo_valid_class(io_service *iosvc, int class_id) {
+    return class_id >= 0 &&
+           (size_t)class_id < dynarr_size(&iosvc->tmo_classes);
+}
+
+inline static tmo_class *tmo_class_at(io_service *iosvc, uint32_t cls) {
+    return (tmo_class *)dynarr_at(&iosvc->tmo_classes, cls);
+}
+
+inline static tmo_entry *tmo_at(io_service *iosvc, uint32_t idx) {
+    return (tmo_entry *)dynarr_at(&iosvc->tmo_entries, idx);
+}
+
+#endif // IOSVC_TMOCLASS_H_
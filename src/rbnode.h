@@ -4,16 +4,34 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
 
 #include "iotypes.h"
+#include "iomem.h"
 
+#define RBNODE_ALIGN 64 // Cache line size
+
+// State of an event used by every completion
 typedef struct event_data {
     io_handler handler;
     io_errcode *status;
     ptrdiff_t ddl_heap_idx;
 } event_data;
 
+// State only used by some events, kept out of the way of the hot one
+typedef struct fd_cold {
+    event_data ex_event; // Exception events are very uncommonly used
+    uint32_t op_slot[3]; // Handle slots, if a handle was requested
+    uint32_t tmo_idx[3]; // Timeout class entries, if timed out by a class
+} fd_cold;
+
+// Aligned as a whole, so that nodes laid out contiguously (e.g. pooled ones)
+// keep their hot events within a single cache line each
 typedef struct rb_node {
+    // Read and write events, indexed by io_wait_type. Kept first, to share a
+    // cache line, as dispatch touches nothing else in the node
+    _Alignas(RBNODE_ALIGN) event_data events[2];
+
     uintptr_t meta; // Parent ptr + Color (R/B) in LSB
 
     union {
@@ -25,27 +43,25 @@ typedef struct rb_node {
     };
 
     int fd;
-    enum {
-        EMPTY = 0,
-        READ,
-        WRITE
-    } main_ev_type;
-
     size_t pollfd_idx;
 
-    // Store one event inline with the node, to avoid allocations, as there
-    // usually is only one event issued per FD.
-    // Said event can be either read or write, exception events are stored
-    // indirectly as they are very uncommonly used
-    event_data main_event;
-    event_data *aux_event;
-    event_data *ex_event;
+    fd_cold *cold; // NULL until an event needs it
+
+    // Links in the service's list of lingering nodes. `idle_pprev` refers to
+    // the link to this node, and is `NULL` if the node is not listed
+    struct rb_node *idle_next;
+    struct rb_node **idle_pprev;
 } rb_node;
 
-inline static rb_node *make_rbnode(int fd) {
-    rb_node *node = (rb_node *)calloc(1, sizeof(*node));
+_Static_assert(sizeof(rb_node) % RBNODE_ALIGN == 0,
+               "rb_node must span whole cache lines");
+
+inline static rb_node *make_rbnode(io_allocator const *alc, int fd) {
+    rb_node *node =
+        (rb_node *)iomem_alloc(alc, sizeof(rb_node), RBNODE_ALIGN);
 
     if (node) {
+        memset(node, 0, sizeof(*node));
         node->fd = fd;
         node->meta = 1UL; // Set as red
     }
@@ -53,18 +69,49 @@ inline static rb_node *make_rbnode(int fd) {
     return node;
 }
 
+inline static void free_rbnode(io_allocator const *alc, rb_node *node) {
+    iomem_free(alc, node->cold, sizeof(fd_cold));
+    iomem_free(alc, node, sizeof(rb_node));
+}
+
+inline static void init_cold(fd_cold *cold) {
+    cold->ex_event.handler.callback = NULL;
+
+    // No handle slots and no timeout class entries (i.e. `OPSLOT_NONE` and
+    // `TMO_NONE`)
+    memset(cold->op_slot, 0xff, sizeof(cold->op_slot));
+    memset(cold->tmo_idx, 0xff, sizeof(cold->tmo_idx));
+}
+
+/**
+ * @brief Get the cold state of a node, allocating it if needed
+ * 
+ * @return The cold state, or `NULL` if no memory could be allocated
+ */
+inline static fd_cold *get_cold(io_allocator const *alc, rb_node *node) {
+    if (node->cold)
+        return node->cold;
+
+    fd_cold *cold =
+        (fd_cold *)iomem_alloc(alc, sizeof(*cold), _Alignof(fd_cold));
+
+    if (cold)
+        init_cold(cold);
+
+    return node->cold = cold;
+}
+
 inline static event_data *get_evt_data(rb_node *node, io_wait_type ev_type) {
-    if (ev_type == WAIT_EXCEPTION)
-        return node->ex_event;
+    if (ev_type != WAIT_EXCEPTION)
+        return &node->events[ev_type];
 
-    if (node->main_ev_type == EMPTY)
-        return NULL;
+    return node->cold ? &node->cold->ex_event : NULL;
+}
 
-    if ((node->main_ev_type == READ && ev_type == WAIT_READ) ||
-        (node->main_ev_type == WRITE && ev_type == WAIT_WRITE))
-        return &node->main_event;
+inline static int is_pending(rb_node *node, io_wait_type ev_type) {
+    event_data *evt = get_evt_data(node, ev_type);
 
-    return node->aux_event;
+    return evt && evt->handler.callback;
 }
 
 #endif // IO_RBNODE_H_
@@ -235,8 +235,11 @@ rb_node *rb_extract(rb_place place, rb_node *parent, rb_node **root_ref) {
         if (tmp)
             set_parent(tmp, pred);
 
-        parent = pred;
+        // The probe starts below pred, so it reports no parent if the node
+        // is pred's direct child
         place = rb_probe(&pred->left, &parent, fd);
+        if (!parent)
+            parent = pred;
     }
 
     rb_node *son = curr_node->child[LEFT] ?
@@ -0,0 +1,260 @@
+// Dispatch microbenchmark: many FDs, each with a read and a write pending,
+// all ready at every iteration. Handlers re-arm their events, so the loop
+// only measures dispatch (and the poll() call itself).
+//
+// A second part replays the memory accesses of dispatch over a large number
+// of FDs, both on the node layout used before the hot/cold split (read or
+// write event inline, the other one allocated separately) and on the current
+// `rb_node`, so that the cache-miss reduction can be checked on a single
+// build. Cache misses are read from hardware counters (perf_event_open()),
+// when the system allows it; `perf stat -e cache-misses ./bench_dispatch`
+// gives the same figures for the whole run otherwise.
+
+#include "io_service.h"
+#include "src/rbnode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define ROUNDS 200
+
+#define LAYOUT_FDS    (1 << 18) // Well beyond the last level cache
+#define LAYOUT_ROUNDS 10
+
+io_service *iosvc;
+int (*socks)[2];
+size_t nsocks = 4096;
+size_t handled;
+
+void on_ready(void *arg);
+
+void arm(size_t idx, io_wait_type wait_type) {
+    uintptr_t ctx = (uintptr_t)idx << 1 | (wait_type == WAIT_WRITE);
+
+    iosvc_sched(iosvc, (io_event){socks[idx][0], wait_type},
+                (io_handler){on_ready, (void *)ctx}, NULL);
+}
+
+void on_ready(void *arg) {
+    uintptr_t ctx = (uintptr_t)arg;
+
+    // Both events of each FD are dispatched once per round
+    if (++handled < 2 * nsocks * ROUNDS)
+        arm(ctx >> 1, (ctx & 1) ? WAIT_WRITE : WAIT_READ);
+}
+
+int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Hardware cache-miss counter of the calling thread, or -1 if unavailable
+int open_miss_counter(void) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void counter_start(int fd) {
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+// Misses counted since `counter_start()`, or -1 if unavailable
+long long counter_stop(int fd) {
+    long long misses;
+
+    if (fd < 0)
+        return -1;
+
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    return read(fd, &misses, sizeof(misses)) == sizeof(misses) ? misses : -1;
+}
+
+void print_misses(char const *what, long long misses, double per) {
+    if (misses < 0)
+        printf("%s: cache misses n/a (perf events unavailable)\n", what);
+    else
+        printf("%s: %.2f cache misses per ready FD\n", what,
+               (double)misses / per);
+}
+
+// Node layout before the hot/cold split: the first event of an FD is stored
+// inline, after the tree links, and the second one is allocated separately
+typedef struct old_event {
+    io_handler handler;
+    io_errcode *status;
+    ptrdiff_t ddl_heap_idx;
+    uint32_t op_slot;
+    uint32_t tmo_idx;
+} old_event;
+
+typedef struct old_node {
+    uintptr_t meta;
+    struct old_node *child[2];
+    int fd;
+    int main_ev_type;
+    size_t pollfd_idx;
+    old_event main_event;
+    old_event *aux_event;
+    old_event *ex_event;
+} old_node;
+
+size_t sink;
+
+// What dispatch reads for an FD with both events ready
+void touch_old(old_node *node) {
+    old_event *rd = node->main_ev_type == WAIT_READ ? &node->main_event
+                                                    : node->aux_event;
+    old_event *wr = node->main_ev_type == WAIT_READ ? node->aux_event
+                                                    : &node->main_event;
+
+    sink += (uintptr_t)rd->handler.ctx + (uintptr_t)rd->status +
+            (size_t)rd->ddl_heap_idx;
+    sink += (uintptr_t)wr->handler.ctx + (uintptr_t)wr->status +
+            (size_t)wr->ddl_heap_idx;
+}
+
+void touch_new(rb_node *node) {
+    for (int i = 0; i < 2; ++i)
+        sink += (uintptr_t)node->events[i].handler.ctx +
+                (uintptr_t)node->events[i].status +
+                (size_t)node->events[i].ddl_heap_idx;
+}
+
+// Visit the FDs of both layouts in the same order as ready pollfds would
+// be, i.e. unrelated to the order nodes were allocated in
+void compare_layouts(int counter) {
+    size_t *order = malloc(LAYOUT_FDS * sizeof(*order));
+    old_node **old_nodes = malloc(LAYOUT_FDS * sizeof(*old_nodes));
+    rb_node **new_nodes = malloc(LAYOUT_FDS * sizeof(*new_nodes));
+
+    for (size_t i = 0; i < LAYOUT_FDS; ++i) {
+        order[i] = i;
+
+        // The second event was allocated later, away from its node
+        old_nodes[i] = calloc(1, sizeof(old_node));
+        old_nodes[i]->main_ev_type = (int)(i & 1);
+        new_nodes[i] = make_rbnode(&iomem_default, (int)i);
+    }
+
+    for (size_t i = 0; i < LAYOUT_FDS; ++i)
+        old_nodes[i]->aux_event = calloc(1, sizeof(old_event));
+
+    srand(1);
+    for (size_t i = LAYOUT_FDS - 1; i > 0; --i) {
+        size_t j = (size_t)rand() % (i + 1);
+        size_t tmp = order[i];
+
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    double visits = (double)LAYOUT_FDS * LAYOUT_ROUNDS;
+
+    counter_start(counter);
+    int64_t start = now_ns();
+    for (int r = 0; r < LAYOUT_ROUNDS; ++r)
+        for (size_t i = 0; i < LAYOUT_FDS; ++i)
+            touch_old(old_nodes[order[i]]);
+    int64_t old_ns = now_ns() - start;
+    long long old_misses = counter_stop(counter);
+
+    counter_start(counter);
+    start = now_ns();
+    for (int r = 0; r < LAYOUT_ROUNDS; ++r)
+        for (size_t i = 0; i < LAYOUT_FDS; ++i)
+            touch_new(new_nodes[order[i]]);
+    int64_t new_ns = now_ns() - start;
+    long long new_misses = counter_stop(counter);
+
+    printf("layouts, %d FDs in pollfd order:\n", LAYOUT_FDS);
+    printf("old layout: %.1f ns per ready FD\n", (double)old_ns / visits);
+    print_misses("old layout", old_misses, visits);
+    printf("new layout: %.1f ns per ready FD\n", (double)new_ns / visits);
+    print_misses("new layout", new_misses, visits);
+
+    for (size_t i = 0; i < LAYOUT_FDS; ++i) {
+        free(old_nodes[i]->aux_event);
+        free(old_nodes[i]);
+        free_rbnode(&iomem_default, new_nodes[i]);
+    }
+
+    free(new_nodes);
+    free(old_nodes);
+    free(order);
+}
+
+int main(void) {
+    struct rlimit lim;
+
+    // Two FDs per socket pair, plus some headroom
+    getrlimit(RLIMIT_NOFILE, &lim);
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+
+    if (lim.rlim_cur < 2 * nsocks + 16)
+        nsocks = (lim.rlim_cur - 16) / 2;
+
+    socks = calloc(nsocks, sizeof(*socks));
+    iosvc = iosvc_create();
+
+    for (size_t i = 0; i < nsocks; ++i) {
+        socketpair(AF_UNIX, SOCK_STREAM, 0, socks[i]);
+
+        // Never drained, so the socket stays readable (and writable)
+        write(socks[i][1], "x", 1);
+
+        arm(i, WAIT_READ);
+        arm(i, WAIT_WRITE);
+    }
+
+    int counter = open_miss_counter();
+
+    counter_start(counter);
+    int64_t start = now_ns();
+    io_errcode errc = iosvc_run(iosvc);
+    int64_t elapsed = now_ns() - start;
+    long long misses = counter_stop(counter);
+
+    printf("run: %s, %zu FDs, %d rounds, %zu handlers\n", ioec_strerr(errc),
+           nsocks, ROUNDS, handled);
+    printf("%.1f ns per ready FD (including poll)\n",
+           (double)elapsed / ((double)handled / 2));
+    print_misses("dispatch", misses, (double)handled / 2);
+
+    for (size_t i = 0; i < nsocks; ++i) {
+        close(socks[i][0]);
+        close(socks[i][1]);
+    }
+
+    free(socks);
+    iosvc_delete(iosvc);
+
+    compare_layouts(counter);
+
+    if (counter >= 0)
+        close(counter);
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include "io_service.h"
+#include "async_rdwr.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+io_service *iosvc;
+int socks[2];
+
+char const *msgs[] = {"HTTP/1.1 200 OK\r\n", "Content-Length: 5\r\n\r\n", "hello"};
+size_t xfer[3];
+io_errcode errcs[3];
+
+char rdbuf[128];
+size_t rd_xfer;
+io_errcode rd_errc;
+
+void write_done(void *arg) {
+    size_t idx = (size_t)arg;
+    printf("write %zu done (st=%s, %zu bytes)\n", idx,
+           ioec_strerr(errcs[idx]), xfer[idx]);
+}
+
+void read_done(void *arg) {
+    (void)arg;
+    printf("peer got %zu bytes in one read (st=%s): %.*s\n", rd_xfer,
+           ioec_strerr(rd_errc), (int)rd_xfer, rdbuf);
+}
+
+void respond(void *arg) {
+    (void)arg;
+
+    // Three small writes, flushed with a single writev() at end of tick
+    for (size_t i = 0; i < 3; ++i)
+        async_write(iosvc, socks[0], msgs[i], strlen(msgs[i]),
+                    (io_handler){write_done, (void *)i}, &xfer[i], &errcs[i]);
+}
+
+int main() {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, socks);
+    fcntl(socks[0], F_SETFL, fcntl(socks[0], F_GETFL) | O_NONBLOCK);
+
+    iosvc = iosvc_create();
+    iosvc_set_autocork(iosvc, socks[0], 1);
+
+    iosvc_post(iosvc, (io_handler){respond, NULL});
+    async_read_some(iosvc, socks[1], rdbuf, sizeof(rdbuf),
+                    (io_handler){read_done, NULL}, &rd_xfer, &rd_errc);
+
+    iosvc_run(iosvc);
+    iosvc_delete(iosvc);
+    close(socks[0]);
+    close(socks[1]);
+
+    return 0;
+}
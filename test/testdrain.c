@@ -0,0 +1,61 @@
+#include "io_service.h"
+#include "async_rdwr.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+io_service *iosvc;
+int listener[2];
+int conn[2];
+
+io_errcode acc_errc, rd_errc;
+size_t rd_xfer;
+char rdbuf[16];
+
+void accept_ready(void *arg) {
+    (void)arg;
+    // Stopped as soon as the drain starts, as no new work is accepted
+    printf("listener: %s\n", ioec_strerr(acc_errc));
+}
+
+void request_read(void *arg) {
+    (void)arg;
+    // Completes normally, as it was in flight when the drain started
+    printf("request: %s, %zu bytes\n", ioec_strerr(rd_errc), rd_xfer);
+}
+
+void peer_send(void *arg) {
+    (void)arg;
+    write(conn[1], "hello", 5);
+}
+
+void on_sigterm(void *arg) {
+    (void)arg;
+    iosvc_drain(iosvc, iosvc_now() + 1000);
+}
+
+int main() {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, listener);
+    socketpair(AF_UNIX, SOCK_STREAM, 0, conn);
+
+    iosvc = iosvc_create();
+    iosvc_set_listener(iosvc, listener[0], 1);
+
+    iosvc_sched(iosvc, (io_event){listener[0], WAIT_READ},
+                (io_handler){accept_ready, NULL}, &acc_errc);
+    async_read(iosvc, conn[0], rdbuf, 5, (io_handler){request_read, NULL},
+               &rd_xfer, &rd_errc);
+    iosvc_post_delay(iosvc, (io_handler){peer_send, NULL}, NULL, 100);
+    iosvc_post(iosvc, (io_handler){on_sigterm, NULL});
+
+    printf("run: %s\n", ioec_strerr(iosvc_run(iosvc)));
+    iosvc_delete(iosvc);
+
+    for (int i = 0; i < 2; ++i) {
+        close(listener[i]);
+        close(conn[i]);
+    }
+
+    return 0;
+}
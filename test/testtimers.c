@@ -0,0 +1,95 @@
+#include "io_service.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+io_service *iosvc;
+
+io_op_handle heartbeat_op;
+io_errcode heartbeat_st;
+int ticks;
+
+io_op_handle request_op;
+io_errcode request_st;
+
+int idle_class;
+io_errcode idle_st;
+int idle_remaining;
+
+long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000LL;
+}
+
+long long start;
+
+void heartbeat(void *arg) {
+    (void)arg;
+
+    if (heartbeat_st != EIO_OK) {
+        printf("heartbeat finished (st=%s)\n", ioec_strerr(heartbeat_st));
+        return;
+    }
+
+    printf("heartbeat %d at +%lld ms (st=%s)\n", ++ticks, now_ms() - start,
+           ioec_strerr(heartbeat_st));
+
+    // Simulate a slow handler; the next tick must not drift
+    struct timespec busy = {0, 30000000};
+    nanosleep(&busy, NULL);
+
+    if (ticks == 5)
+        printf("cancel heartbeat: %s\n",
+               ioec_strerr(iosvc_cancel_op(iosvc, heartbeat_op)));
+}
+
+void request_timeout(void *arg) {
+    (void)arg;
+    printf("request timeout handler (st=%s)\n", ioec_strerr(request_st));
+}
+
+void request_done(void *arg) {
+    (void)arg;
+    printf("request done, cancel its timeout: %s\n",
+           ioec_strerr(iosvc_cancel_op(iosvc, request_op)));
+    printf("cancel again: %s\n",
+           ioec_strerr(iosvc_cancel_op(iosvc, request_op)));
+}
+
+void idle_timeout(void *arg) {
+    (void)arg;
+    printf("idle read finished at +%lld ms (st=%s, remaining=%d)\n",
+           now_ms() - start, ioec_strerr(idle_st), idle_remaining);
+}
+
+int main() {
+    iosvc = iosvc_create();
+    start = now_ms();
+
+    iosvc_post_periodic(iosvc, (io_handler){heartbeat, NULL}, &heartbeat_st,
+                        100, &heartbeat_op);
+
+    iosvc_post_delay_op(iosvc, (io_handler){request_timeout, NULL},
+                        &request_st, 30000, &request_op);
+    iosvc_post_delay(iosvc, (io_handler){request_done, NULL}, NULL, 250);
+
+    // Idle timeouts all have the same duration, so they use a timeout class
+    int pipefd[2];
+    pipe(pipefd);
+
+    iosvc_add_timeout_class(iosvc, 200, 0, &idle_class);
+    iosvc_sched_class_timeout(iosvc, (io_event){pipefd[0], WAIT_READ},
+                              (io_handler){idle_timeout, NULL}, &idle_st,
+                              idle_class, &idle_remaining, NULL);
+
+    printf("run: %s\n", ioec_strerr(iosvc_run(iosvc)));
+    printf("finished at +%lld ms\n", now_ms() - start);
+    iosvc_delete(iosvc);
+
+    close(pipefd[0]);
+    close(pipefd[1]);
+
+    return 0;
+}